@@ -0,0 +1,215 @@
+#include "autotuner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+constexpr const char *tableMagic = "mandelbrot-autotune-1";
+
+/// row band sizes tried with own thread pool
+constexpr std::size_t calibrationBandRows[] = {1, 8, 32};
+
+/// measurements of one backend are repeated until this much time is spent (best one is kept)
+constexpr double measureBudgetMs = 20;
+
+std::string hostName()
+{
+    char name[256] = {};
+    if (::gethostname(name, sizeof(name) - 1) != 0 || name[0] == '\0') {
+        return "localhost";
+    }
+    return name;
+}
+
+bool kindFromString(const std::string &str, AutoTuner::Backend::Kind &kind)
+{
+    for (const auto k : {AutoTuner::Backend::Kind::Serial,
+                         AutoTuner::Backend::Kind::ParallelStl,
+                         AutoTuner::Backend::Kind::Threads}) {
+        if (AutoTuner::Backend::kindName(k) == str) {
+            kind = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+double logDistance(std::size_t a, std::size_t b)
+{
+    return std::abs(std::log2(double(std::max<std::size_t>(a, 1)))
+                    - std::log2(double(std::max<std::size_t>(b, 1))));
+}
+
+} // namespace
+
+AutoTuner::AutoTuner(const std::string &path, const e172::ComplexFunction<double> &function)
+    : m_path(path)
+    , m_function(function)
+    , m_concurrency(std::max(1u, std::thread::hardware_concurrency()))
+{}
+
+std::string AutoTuner::defaultPath(const std::string &functionName)
+{
+    std::filesystem::path dir;
+    if (const auto cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        dir = cache;
+    } else if (const auto home = std::getenv("HOME"); home && *home) {
+        dir = std::filesystem::path(home) / ".cache";
+    } else {
+        dir = ".";
+    }
+    return dir / "mandelbrot" / ("autotune_" + hostName() + "_" + functionName + ".txt");
+}
+
+bool AutoTuner::load()
+{
+    std::ifstream stream(m_path);
+    std::string magic;
+    std::size_t concurrency = 0;
+    if (!(stream >> magic >> concurrency) || magic != tableMagic
+        || concurrency != m_concurrency) {
+        return false;
+    }
+
+    std::vector<Decision> decisions;
+    Decision decision;
+    std::string kind;
+    while (stream >> decision.resolution >> decision.depth >> kind >> decision.backend.threads
+           >> decision.backend.bandRows >> decision.ms) {
+        if (!kindFromString(kind, decision.backend.kind)) {
+            return false;
+        }
+        decisions.push_back(decision);
+    }
+    if (decisions.empty()) {
+        return false;
+    }
+    m_decisions = std::move(decisions);
+    return true;
+}
+
+bool AutoTuner::save() const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(m_path).parent_path(), ec);
+    std::ofstream stream(m_path);
+    if (!stream) {
+        return false;
+    }
+    stream << tableMagic << " " << m_concurrency << "\n";
+    for (const auto &decision : m_decisions) {
+        stream << decision.resolution << " " << decision.depth << " "
+               << Backend::kindName(decision.backend.kind) << " " << decision.backend.threads << " "
+               << decision.backend.bandRows << " " << decision.ms << "\n";
+    }
+    return bool(stream);
+}
+
+std::vector<AutoTuner::Backend> AutoTuner::candidates() const
+{
+    std::vector<Backend> result = {{.kind = Backend::Kind::Serial},
+                                   {.kind = Backend::Kind::ParallelStl}};
+    std::vector<std::size_t> threadCounts;
+    for (std::size_t threads = 2; threads < m_concurrency; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    if (m_concurrency > 1) {
+        threadCounts.push_back(m_concurrency);
+    }
+    for (const auto threads : threadCounts) {
+        for (const auto bandRows : calibrationBandRows) {
+            result.push_back({.kind = Backend::Kind::Threads,
+                              .threads = threads,
+                              .bandRows = bandRows});
+        }
+    }
+    return result;
+}
+
+double AutoTuner::measure(const Backend &backend,
+                          std::size_t resolution,
+                          std::size_t depth,
+                          std::vector<e172::Color> &frame) const
+{
+    // same viewport as FractalView starts with
+    const RenderOptions options{.colorMask = 0xffffffff, .backend = backend};
+    const RenderTarget target{.pixels = frame, .width = resolution, .height = resolution};
+
+    double best = std::numeric_limits<double>::max();
+    double spent = 0;
+    do {
+        const auto begin = std::chrono::steady_clock::now();
+        render({}, m_function, depth, options, target);
+        const auto ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - begin)
+                            .count();
+        best = std::min(best, ms);
+        spent += ms;
+    } while (spent < measureBudgetMs);
+    return best;
+}
+
+void AutoTuner::calibrate(std::ostream &log)
+{
+    const auto backends = candidates();
+    log << "Calibrating compute backends (" << backends.size() << " candidates, "
+        << m_concurrency << " hardware threads)" << std::endl;
+
+    std::vector<e172::Color> frame;
+    std::vector<Decision> decisions;
+    for (const auto resolution : calibrationResolutions) {
+        frame.resize(resolution * resolution);
+        for (const auto depth : calibrationDepths) {
+            Decision best{.resolution = resolution,
+                          .depth = depth,
+                          .backend = {},
+                          .ms = std::numeric_limits<double>::max()};
+            for (const auto &backend : backends) {
+                const auto ms = measure(backend, resolution, depth, frame);
+                if (ms < best.ms) {
+                    best.backend = backend;
+                    best.ms = ms;
+                }
+            }
+            log << "  " << resolution << "x" << resolution << " depth " << depth << ": "
+                << best.backend.toString() << " (" << best.ms << " ms)" << std::endl;
+            decisions.push_back(best);
+        }
+    }
+    m_decisions = std::move(decisions);
+}
+
+void AutoTuner::loadOrCalibrate(std::ostream &log)
+{
+    if (load()) {
+        log << "Compute backend table loaded from " << m_path << std::endl;
+        return;
+    }
+    calibrate(log);
+    if (save()) {
+        log << "Compute backend table saved to " << m_path << std::endl;
+    } else {
+        log << "Warning: can not save compute backend table to " << m_path << std::endl;
+    }
+}
+
+AutoTuner::Backend AutoTuner::choose(std::size_t resolution, std::size_t depth) const
+{
+    const auto nearest = std::min_element(m_decisions.begin(),
+                                          m_decisions.end(),
+                                          [resolution, depth](const auto &a, const auto &b) {
+                                              return logDistance(a.resolution, resolution)
+                                                         + logDistance(a.depth, depth)
+                                                     < logDistance(b.resolution, resolution)
+                                                           + logDistance(b.depth, depth);
+                                          });
+    return nearest != m_decisions.end() ? nearest->backend : Backend{};
+}
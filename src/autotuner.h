@@ -0,0 +1,79 @@
+#pragma once
+
+#include "renderengine.h"
+
+#include <cstddef>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The AutoTuner class measures which parallel backend renders fastest on this machine.
+ * Calibration renders the whole plane of one function with every backend (serial, parallel
+ * STL, own thread pool with several thread counts and row band sizes) at a grid of
+ * resolutions and depths. The resulting decision table is stored per host and function, so
+ * calibration runs only once. Small or shallow frames usually go serial, since spawning
+ * work costs more than it saves.
+ */
+class AutoTuner
+{
+public:
+    using Backend = RenderBackend;
+
+    struct Decision
+    {
+        std::size_t resolution;
+        std::size_t depth;
+        Backend backend;
+        /// measured duration of a full frame
+        double ms;
+    };
+
+    static constexpr std::size_t calibrationResolutions[] = {64, 128, 256, 512};
+    static constexpr std::size_t calibrationDepths[] = {16, 64, 256};
+
+    AutoTuner(const std::string &path, const e172::ComplexFunction<double> &function);
+
+    /**
+     * @brief defaultPath - decision table location for this host and function
+     * ($XDG_CACHE_HOME or ~/.cache)/mandelbrot/autotune_<host>_<function>.txt
+     */
+    static std::string defaultPath(const std::string &functionName);
+
+    const std::string &path() const { return m_path; }
+    const std::vector<Decision> &decisions() const { return m_decisions; }
+
+    /**
+     * @brief load - reads decision table
+     * @return false if it is missing or was measured with other hardware concurrency
+     */
+    bool load();
+    bool save() const;
+    void calibrate(std::ostream &log);
+
+    /**
+     * @brief loadOrCalibrate - calibrates and saves table on first use
+     */
+    void loadOrCalibrate(std::ostream &log);
+
+    /**
+     * @brief choose - backend of the decision nearest (in log scale) to frame parameters
+     * @param resolution - number of computed samples per side
+     */
+    Backend choose(std::size_t resolution, std::size_t depth) const;
+
+private:
+    std::vector<Backend> candidates() const;
+    double measure(const Backend &backend,
+                   std::size_t resolution,
+                   std::size_t depth,
+                   std::vector<e172::Color> &frame) const;
+
+private:
+    std::string m_path;
+    e172::ComplexFunction<double> m_function;
+    std::size_t m_concurrency;
+    std::vector<Decision> m_decisions;
+};
@@ -0,0 +1,80 @@
+#include "complexfunctions.h"
+
+namespace {
+
+constexpr Symmetry conjugate{.conjugate = true};
+
+template<int Scale>
+e172::Complex<double> floorSqr(const e172::Complex<double> &x)
+{
+    const auto t = x * x * double(Scale);
+    return e172::Complex<double>{std::floor(t.real()), std::floor(t.imag())} / double(Scale);
+}
+
+} // namespace
+
+const std::map<std::string, ComplexFunctionEntry> &complexFunctions()
+{
+    // functions with real coefficients commute with conjugation, odd ones with negation.
+    // derivatives are given for holomorphic ones
+    static const std::map<std::string, ComplexFunctionEntry> result
+        = {{"x",
+            {[](const auto &x) { return x; },
+             {.conjugate = true, .rotation = 2},
+             [](const auto &) { return e172::Complex<double>(1); }}},
+           {"sqr",
+            {e172::Math::sqr<e172::Complex<double>>,
+             conjugate,
+             [](const auto &x) { return 2. * x; },
+             true,
+             true}},
+           {"sin",
+            {[](const auto &x) { return std::sin(x); },
+             {.conjugate = true, .rotation = 2},
+             [](const auto &x) { return std::cos(x); }}},
+           {"cos",
+            {[](const auto &x) { return std::cos(x); },
+             conjugate,
+             [](const auto &x) { return -std::sin(x); }}},
+           {"sin_sqr",
+            {[](const auto &x) { return std::sin(x * x); },
+             conjugate,
+             [](const auto &x) { return 2. * x * std::cos(x * x); }}},
+           {"cos_sqr",
+            {[](const auto &x) { return std::cos(x * x); },
+             conjugate,
+             [](const auto &x) { return -2. * x * std::sin(x * x); }}},
+           {"tan_sqr",
+            {[](const auto &x) { return std::tan(x * x); },
+             conjugate,
+             [](const auto &x) {
+                 const auto cos = std::cos(x * x);
+                 return 2. * x / (cos * cos);
+             }}},
+           {"asin_sqr",
+            {[](const auto &x) { return std::asin(x * x); },
+             conjugate,
+             [](const auto &x) { return 2. * x / std::sqrt(1. - x * x * x * x); }}},
+           {"log_sqr",
+            {[](const auto &x) { return std::log(x * x); },
+             conjugate,
+             [](const auto &x) { return 2. / x; }}},
+           {"exp_sqr",
+            {[](const auto &x) { return std::exp(x * x); },
+             conjugate,
+             [](const auto &x) { return 2. * x * std::exp(x * x); }}},
+           {"sigm_sqr", {[](const auto &x) { return e172::Math::sigm(x * x); }, {}}},
+           {"floor2_sqr", {floorSqr<2>, {}}},
+           {"floor4_sqr", {floorSqr<4>, {}}},
+           {"floor8_sqr", {floorSqr<8>, {}}},
+           {"floor16_sqr", {floorSqr<16>, {}}},
+           {"floor32_sqr", {floorSqr<32>, {}}},
+           {"sgn_sqr", {[](const auto &x) { return e172::Math::sgn(x * x); }, {}}}};
+    return result;
+}
+
+const std::string &defaultComplexFunctionName()
+{
+    static const std::string result = "sqr";
+    return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "symmetry.h"
+
+#include <e172/math/math.h>
+#include <map>
+#include <string>
+
+struct ComplexFunctionEntry
+{
+    e172::ComplexFunction<double> function;
+    Symmetry symmetry;
+    /// f' for holomorphic functions (distance estimation), empty otherwise
+    e172::ComplexFunction<double> derivative = {};
+    /// f is a polynomial of degree >= 2, so distance estimates are bounded (Koebe) and exterior
+    /// disks can be filled without sampling
+    bool polynomial = false;
+    /// f(z) = z^2, iterated by dedicated kernels (Julia atlas)
+    bool quadratic = false;
+};
+
+/**
+ * @brief complexFunctions - registry of functions f for z -> f(z) + c selectable with --func
+ */
+const std::map<std::string, ComplexFunctionEntry> &complexFunctions();
+
+const std::string &defaultComplexFunctionName();
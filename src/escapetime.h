@@ -0,0 +1,144 @@
+#pragma once
+
+#include "symmetry.h"
+
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+/**
+ * @brief JuliaParameter - fixed c of Julia mode. When set, a sample is the starting point z0 of
+ * z -> f(z) + c instead of c (Mandelbrot mode, z0 = 0)
+ */
+using JuliaParameter = std::optional<e172::Complex<double>>;
+
+/**
+ * @brief escapeLevel - number of iterations before |z| > 2 (depth inside the set)
+ */
+inline std::size_t escapeLevel(const e172::Complex<double> &sample,
+                               std::size_t depth,
+                               const e172::ComplexFunction<double> &function,
+                               const JuliaParameter &julia)
+{
+    if (!julia) {
+        return e172::Math::fractalLevel(sample, depth, function);
+    }
+    auto z = sample;
+    for (std::size_t i = 0; i < depth; ++i) {
+        z = function(z) + *julia;
+        if (std::norm(z) > 4) {
+            return i;
+        }
+    }
+    return depth;
+}
+
+/**
+ * @brief escapeColor - color of sample c as FractalView shows it (not blended with background)
+ */
+inline e172::Color escapeColor(const e172::Complex<double> &c,
+                               std::size_t depth,
+                               const e172::ComplexFunction<double> &function,
+                               e172::Color colorMask,
+                               const JuliaParameter &julia = std::nullopt)
+{
+    const auto level = escapeLevel(c, depth, function, julia);
+    return e172::Color(colorMask * (double(level) / double(depth)));
+}
+
+/**
+ * @brief escapeSymmetry - symmetry of the plane that is rendered. Symmetry of registry
+ * functions holds in the c plane only, Julia sets are rendered without it
+ */
+inline Symmetry escapeSymmetry(const Symmetry &symmetry, const JuliaParameter &julia)
+{
+    return julia ? Symmetry{} : symmetry;
+}
+
+/**
+ * @brief escapeSmoothLevel - continuous escape level of c (same iteration and bailout as
+ * e172::Math::fractalLevel, fractional part from the final |z|). Returns depth inside the set
+ */
+inline double escapeSmoothLevel(const e172::Complex<double> &c,
+                                std::size_t depth,
+                                const e172::ComplexFunction<double> &function)
+{
+    e172::Complex<double> z = 0;
+    for (std::size_t i = 0; i < depth; ++i) {
+        z = function(z) + c;
+        const auto norm = std::norm(z);
+        if (norm > 4) {
+            const auto smooth = double(i) + 1 - std::log2(std::log2(norm) / 2);
+            return std::clamp(smooth, 0., double(depth));
+        }
+    }
+    return double(depth);
+}
+
+/**
+ * @brief The EscapeEstimate struct - escape level and exterior distance estimate of a sample
+ */
+struct EscapeEstimate
+{
+    /// same as escapeLevel
+    std::size_t level;
+    /// estimated distance from the sample to the set, 0 inside. For f(z) = z^2 the true
+    /// distance lies in [distance / 4, distance * 2] (Koebe), for other functions it is heuristic
+    double distance;
+};
+
+/**
+ * @brief escapeEstimate - escapeLevel with derivative tracking: dz/dc (dz/dz0 in Julia mode)
+ * is iterated along with z, escaped orbits continue to a large radius and give the distance
+ * estimate |z| ln|z| / |dz|. Orbits caught in a cycle (checked against a reference point
+ * moved at powers of two, as in Brent's algorithm) are reported inside the set early
+ * @param derivative - f' of a holomorphic function
+ */
+inline EscapeEstimate escapeEstimate(const e172::Complex<double> &sample,
+                                     std::size_t depth,
+                                     const e172::ComplexFunction<double> &function,
+                                     const e172::ComplexFunction<double> &derivative,
+                                     const JuliaParameter &julia)
+{
+    /// squared |z| at which the estimate is taken
+    constexpr double estimateNorm = 1e12;
+    constexpr std::size_t estimateIterations = 64;
+    /// squared distance at which an orbit is considered periodic
+    constexpr double cycleNorm = 1e-24;
+
+    const auto c = julia ? *julia : sample;
+    const e172::Complex<double> dc = julia ? 0 : 1;
+    auto z = julia ? sample : e172::Complex<double>(0);
+    auto dz = julia ? e172::Complex<double>(1) : e172::Complex<double>(0);
+    auto reference = z;
+    std::size_t nextReference = 1;
+    for (std::size_t i = 0; i < depth; ++i) {
+        dz = derivative(z) * dz + dc;
+        z = function(z) + c;
+        if (std::norm(z) > 4) {
+            for (std::size_t j = 0; j < estimateIterations && std::norm(z) < estimateNorm; ++j) {
+                const auto nextDz = derivative(z) * dz + dc;
+                const auto nextZ = function(z) + c;
+                if (!std::isfinite(std::norm(nextZ)) || !std::isfinite(std::norm(nextDz))) {
+                    break;
+                }
+                dz = nextDz;
+                z = nextZ;
+            }
+            const auto r = std::abs(z);
+            const auto distance = r * std::log(r) / std::abs(dz);
+            return {.level = i, .distance = std::isfinite(distance) ? distance : 0.};
+        }
+        if (std::norm(z - reference) < cycleNorm) {
+            return {.level = depth, .distance = 0};
+        }
+        if (i + 1 == nextReference) {
+            reference = z;
+            nextReference *= 2;
+        }
+    }
+    return {.level = depth, .distance = 0};
+}
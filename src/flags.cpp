@@ -25,6 +25,10 @@ Flags Flags::parse(int argc, const char **argv, const std::string &defaultComple
                            e172::Flag{.shortName = "s",
                                       .longName = "static-display",
                                       .description = "Display static image"}),
+                       .serveMode = p.flag<bool>(e172::Flag{
+                           .shortName = "S",
+                           .longName = "serve",
+                           .description = "Serve z/x/y.png tiles over HTTP on localhost"}),
                        .testCount = p.flag(
                            e172::OptFlag<std::size_t>{.shortName = "C",
                                                       .longName = "test-count",
@@ -41,6 +45,12 @@ Flags Flags::parse(int argc, const char **argv, const std::string &defaultComple
                                                       .longName = "depth",
                                                       .description = "Fractal per pixel depth",
                                                       .defaultVal = 32}),
+                       .fps = p.flag(e172::OptFlag<std::size_t>{
+                           .shortName = "F",
+                           .longName = "fps",
+                           .description = "Target frame rate. Refinement passes are fitted into "
+                                          "the frame time",
+                           .defaultVal = 30}),
 
                        .colorMask = p.flag(
                            e172::OptFlag<e172::Color>{.shortName = "m",
@@ -56,7 +66,8 @@ Flags Flags::parse(int argc, const char **argv, const std::string &defaultComple
                        .computeMode = p.flag(e172::OptFlag<FractalView::ComputeMode>{
                            .shortName = "c",
                            .longName = "compute-mode",
-                           .description = "Compute mode [cpu=default, cpu-concurent, gpu]",
+                           .description = "Compute mode [cpu=default, cpu-concurent, gpu, auto]. "
+                                          "auto calibrates backends once per host and function",
                            .defaultVal = FractalView::ComputeMode::CPU}),
                        .backgroundColor = p.flag(
                            e172::OptFlag<e172::Color>{.shortName = "b",
@@ -68,6 +79,85 @@ Flags Flags::parse(int argc, const char **argv, const std::string &defaultComple
                            .longName = "graphics-provider",
                            .description = "Graphics provider [sdl=default, console, vulkan]",
                            .defaultVal = GraphicsProvider::SDL}),
+                       .port = p.flag(
+                           e172::OptFlag<std::size_t>{.shortName = "P",
+                                                      .longName = "port",
+                                                      .description = "Tile server port",
+                                                      .defaultVal = 8080}),
+                       .workers = p.flag(e172::OptFlag<std::size_t>{
+                           .shortName = "W",
+                           .longName = "workers",
+                           .description = "Tile server render threads (0 = hardware concurrency)",
+                           .defaultVal = 0}),
+                       .queueSize = p.flag(
+                           e172::OptFlag<std::size_t>{.shortName = "Q",
+                                                      .longName = "queue-size",
+                                                      .description = "Tile server queue capacity",
+                                                      .defaultVal = 256}),
+                       .tileCache = p.flag(e172::OptFlag<std::string>{
+                           .shortName = "T",
+                           .longName = "tile-cache",
+                           .description = "Tile server disk cache directory",
+                           .defaultVal = "./tile_cache"}),
+                       .outputFormat = p.flag(e172::OptFlag<OutputFormat>{
+                           .shortName = "o",
+                           .longName = "output-format",
+                           .description = "Write mode output [png=default, level, smooth]. "
+                                          "level and smooth write raw iteration data (.mbi)",
+                           .defaultVal = OutputFormat::PNG}),
+                       .colorize = p.flag(e172::OptFlag<std::string>{
+                           .shortName = "z",
+                           .longName = "colorize",
+                           .description = "Color raw iteration data file into png",
+                           .defaultVal = ""}),
+                       .orbitDensity = p.flag(e172::OptFlag<OrbitDensity::Mode>{
+                           .shortName = "O",
+                           .longName = "orbit-density",
+                           .description = "Orbit density rendering [none=default, buddhabrot, "
+                                          "nebulabrot]",
+                           .defaultVal = OrbitDensity::Mode::None}),
+                       .samples = p.flag(e172::OptFlag<std::size_t>{
+                           .shortName = "N",
+                           .longName = "samples",
+                           .description = "Number of sampled orbits in orbit density rendering",
+                           .defaultVal = 10000000}),
+                       .resume = p.flag<bool>(e172::Flag{
+                           .shortName = "R",
+                           .longName = "resume",
+                           .description = "Resume interrupted write mode render from its journal"}),
+                       .record = p.flag(e172::OptFlag<std::string>{
+                           .shortName = "i",
+                           .longName = "record",
+                           .description = "Record key input of the interactive session to file",
+                           .defaultVal = ""}),
+                       .replay = p.flag(e172::OptFlag<std::string>{
+                           .shortName = "y",
+                           .longName = "replay",
+                           .description = "Replay recorded input headless (console provider) and "
+                                          "report input latency to stderr",
+                           .defaultVal = ""}),
+                       .julia = p.flag(e172::OptFlag<JuliaConstant>{
+                           .shortName = "j",
+                           .longName = "julia",
+                           .description = "Render Julia set of fixed parameter c = \"re,im\"",
+                           .defaultVal = JuliaConstant{}}),
+                       .atlas = p.flag(e172::OptFlag<AtlasGrid>{
+                           .shortName = "a",
+                           .longName = "atlas",
+                           .description = "Write COLUMNSxROWS mosaic of Julia set thumbnails "
+                                          "over the parameter plane (resolution = mosaic width)",
+                           .defaultVal = AtlasGrid{}}),
+                       .trace = p.flag(e172::OptFlag<std::string>{
+                           .shortName = "x",
+                           .longName = "trace",
+                           .description = "Write timeline of rows, tiles, passes and encoding as "
+                                          "Chrome trace JSON (open in Perfetto)",
+                           .defaultVal = ""}),
+                       .distance = p.flag<bool>(e172::Flag{
+                           .shortName = "e",
+                           .longName = "distance",
+                           .description = "Shade by distance estimate to the set boundary "
+                                          "(functions marked [distance] in --func-list)"}),
                    };
                },
                [](const e172::FlagParser &p) {
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "fractalview.h"
+#include "orbitdensity.h"
 
 #include <cstddef>
 #include <e172/graphics/color.h>
 #include <e172/utility/flagparser.h>
+#include <sstream>
 #include <string>
 #include <variant>
 
@@ -52,20 +54,125 @@ inline e172::Either<e172::FlagParseError, GraphicsProvider> operator>>(
     }
 }
 
+enum class OutputFormat { PNG, Level, Smooth };
+
+inline e172::Either<e172::FlagParseError, OutputFormat> operator>>(e172::RawFlagValue raw,
+                                                                   e172::TypeTag<OutputFormat>)
+{
+    if (raw.str == "png") {
+        return e172::Right(OutputFormat::PNG);
+    } else if (raw.str == "level") {
+        return e172::Right(OutputFormat::Level);
+    } else if (raw.str == "smooth") {
+        return e172::Right(OutputFormat::Smooth);
+    } else {
+        return e172::Left(e172::FlagParseError::EnumValueNotFound);
+    }
+}
+
+inline std::string toString(OutputFormat format)
+{
+    switch (format) {
+    case OutputFormat::PNG:
+        return "png";
+    case OutputFormat::Level:
+        return "level";
+    case OutputFormat::Smooth:
+        return "smooth";
+    }
+    return "undefined";
+}
+
+/**
+ * @brief The JuliaConstant struct - value of --julia flag "re,im". Disabled when empty
+ */
+struct JuliaConstant
+{
+    bool enabled = false;
+    double re = 0;
+    double im = 0;
+
+    JuliaParameter parameter() const
+    {
+        return enabled ? JuliaParameter(e172::Complex<double>(re, im)) : std::nullopt;
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &stream, const JuliaConstant &julia)
+{
+    return julia.enabled ? stream << julia.re << "," << julia.im : stream << "none";
+}
+
+inline e172::Either<e172::FlagParseError, JuliaConstant> operator>>(e172::RawFlagValue raw,
+                                                                    e172::TypeTag<JuliaConstant>)
+{
+    JuliaConstant result{.enabled = true};
+    char separator = 0;
+    std::istringstream stream(raw.str);
+    if (stream >> result.re >> separator >> result.im && separator == ',' && stream.eof()) {
+        return e172::Right(result);
+    }
+    return e172::Left(e172::FlagParseError::EnumValueNotFound);
+}
+
+/**
+ * @brief The AtlasGrid struct - value of --atlas flag "COLUMNSxROWS". Disabled when empty
+ */
+struct AtlasGrid
+{
+    std::size_t columns = 0;
+    std::size_t rows = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &stream, const AtlasGrid &grid)
+{
+    return grid.columns > 0 ? stream << grid.columns << "x" << grid.rows : stream << "none";
+}
+
+inline e172::Either<e172::FlagParseError, AtlasGrid> operator>>(e172::RawFlagValue raw,
+                                                                e172::TypeTag<AtlasGrid>)
+{
+    AtlasGrid result;
+    char separator = 0;
+    std::istringstream stream(raw.str);
+    if (stream >> result.columns >> separator >> result.rows && separator == 'x' && stream.eof()
+        && result.columns > 0 && result.rows > 0) {
+        return e172::Right(result);
+    }
+    return e172::Left(e172::FlagParseError::EnumValueNotFound);
+}
+
 struct Flags
 {
     bool testMode;
     bool writeMode;
     bool funcList;
     bool staticDisplay;
+    bool serveMode;
     std::size_t testCount;
     std::string function;
     std::size_t depth;
+    std::size_t fps;
     e172::Color colorMask;
     Resolution resolution;
     FractalView::ComputeMode computeMode;
     e172::Color backgroundColor;
     GraphicsProvider graphicsProvider;
+    std::size_t port;
+    std::size_t workers;
+    std::size_t queueSize;
+    std::string tileCache;
+    OutputFormat outputFormat;
+    std::string colorize;
+    OrbitDensity::Mode orbitDensity;
+    std::size_t samples;
+    bool resume;
+    std::string record;
+    std::string replay;
+    JuliaConstant julia;
+    AtlasGrid atlas;
+    std::string trace;
+    bool distance;
 
     static Flags parse(int argc, const char **argv, const std::string &defaultComplexFunctionName);
 };
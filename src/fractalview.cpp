@@ -1,14 +1,16 @@
 #include "fractalview.h"
 
+#include "trace.h"
+
 #include <boost/compute/algorithm/transform.hpp>
 #include <boost/compute/container/vector.hpp>
 #include <boost/compute/core.hpp>
+#include <chrono>
 #include <e172/debug.h>
 #include <e172/eventhandler.h>
 #include <e172/functional/metafunction.h>
 #include <e172/utility/defer.h>
 #include <exception>
-#include <execution>
 #include <iostream>
 
 FractalView::ComputeMode FractalView::computeMode() const {
@@ -26,6 +28,8 @@ std::string FractalView::toString(FractalView::ComputeMode computeMode) {
         return "cpu-concurent";
     } else if (computeMode == ComputeMode::GPU) {
         return "gpu";
+    } else if (computeMode == ComputeMode::Auto) {
+        return "auto";
     } else {
         return "undefined";
     }
@@ -37,17 +41,38 @@ FractalView::FractalView(e172::FactoryMeta &&meta,
                          e172::Color colorMask,
                          e172::Color backgroundColor,
                          const e172::ComplexFunction<double> &function,
-                         ComputeMode computeMode)
+                         const Symmetry &symmetry,
+                         const JuliaParameter &julia,
+                         const DistanceEstimation &distance,
+                         ComputeMode computeMode,
+                         std::size_t targetFps,
+                         std::shared_ptr<const AutoTuner> autoTuner,
+                         std::shared_ptr<InputRecorder> inputRecorder,
+                         std::shared_ptr<LatencyProbe> latencyProbe)
     : e172::Entity(std::forward<e172::FactoryMeta>(meta))
     , m_resolution(resolution)
     , m_depthMultiplier(depthMultiplier)
     , m_colorMask(colorMask)
     , m_backgroundColor(backgroundColor)
     , m_function(function)
+    , m_symmetry(escapeSymmetry(symmetry, julia))
+    , m_julia(julia)
+    , m_distance(distance)
     , m_computeMode(computeMode)
+    , m_autoTuner(std::move(autoTuner))
+    , m_governor(1000. / double(std::max<std::size_t>(targetFps, 1)), maxDeterioration)
+    , m_deterioration(maxDeterioration)
     , m_inputTimers({64, 64, 64})
-    , m_updateResolutionBegin(m_resolution / 64)
-    , m_updateResolution(m_updateResolutionBegin)
+    , m_inputRecorder(std::move(inputRecorder))
+    , m_latencyProbe(std::move(latencyProbe))
+    , m_prefetcher(std::make_unique<Prefetcher>(
+          prefetchCapacity,
+          m_resolution * m_resolution,
+          [this](const Prefetcher::Viewport &viewport,
+                 e172::Color *frame,
+                 const std::atomic<bool> &preempted) {
+              return prefetchFrame(viewport, frame, preempted);
+          }))
 {
     if (computeMode == ComputeMode::GPU) {
         boost::compute::device device = boost::compute::system::default_device();
@@ -78,116 +103,190 @@ FractalView::FractalView(e172::FactoryMeta &&meta,
     }
 }
 
+void FractalView::restartRefinement()
+{
+    m_deterioration = m_governor.startDeterioration(m_resolution,
+                                                    expRoof(m_depthMultiplier * m_zoom));
+}
+
+void FractalView::schedulePrefetch()
+{
+    auto left = m_offset;
+    left.decrementX(0.1 / m_zoom);
+    auto right = m_offset;
+    right.incrementX(0.1 / m_zoom);
+    auto up = m_offset;
+    up.decrementY(0.1 / m_zoom);
+    auto down = m_offset;
+    down.incrementY(0.1 / m_zoom);
+
+    // same arithmetic as in proceed so that viewports compare equal
+    m_prefetcher->schedule({{left, m_zoom},
+                            {right, m_zoom},
+                            {up, m_zoom},
+                            {down, m_zoom},
+                            {m_offset, m_zoom / 0.9},
+                            {m_offset, m_zoom * 0.9}});
+}
+
+RenderOptions FractalView::renderOptions() const
+{
+    return {.colorMask = m_colorMask,
+            .backgroundColor = m_backgroundColor,
+            .symmetry = m_symmetry,
+            .julia = m_julia,
+            .distance = m_distance};
+}
+
+bool FractalView::prefetchFrame(const Prefetcher::Viewport &viewport,
+                                e172::Color *frame,
+                                const std::atomic<bool> &preempted) const
+{
+    TraceScope scope("prefetch");
+    auto options = renderOptions();
+    options.cancelled = &preempted;
+    return ::render({viewport.offset, viewport.zoom},
+                    m_function,
+                    expRoof(m_depthMultiplier * viewport.zoom),
+                    options,
+                    {.pixels = {frame, m_resolution * m_resolution},
+                     .width = m_resolution,
+                     .height = m_resolution});
+}
+
+void FractalView::drawInfo(e172::AbstractRenderer *renderer, size_t depth, size_t deteriorationCoef)
+{
+    TraceScope scope("draw_info");
+    const auto xyz_string = "{ " + std::to_string(m_offset.x()) + ", "
+                            + std::to_string(m_offset.y()) + ", " + std::to_string(m_zoom) + " }";
+    const auto depth_string = "\nDepth: " + std::to_string(depth)
+                              + " Deterioration: " + std::to_string(deteriorationCoef)
+                              + "\nPrefetch: " + std::to_string(m_prefetcher->hits()) + "/"
+                              + std::to_string(m_prefetcher->hits() + m_prefetcher->misses())
+                              + " (" + std::to_string(int(m_prefetcher->hitRate() * 100)) + "%)";
+    if(xyz_string.size() > 0) {
+        std::cout << "r/ss: " << m_resolution << " / " << xyz_string.size() << "\n";
+        renderer->drawString(xyz_string + depth_string, { 8, 8. }, 0xffffff, e172::TextFormat::fromFontSize(m_resolution / xyz_string.size()));
+    }
+}
+
 void FractalView::proceed(e172::Context *, e172::EventHandler *eventHandler) {
+    if (m_inputRecorder) {
+        m_inputRecorder->sample(eventHandler, controlKeys);
+    }
+
+    bool changed = false;
     if (m_inputTimers[0].check(eventHandler->keyHolded(e172::ScancodeMinus))) {
         m_zoom *= 0.9;
-        m_updateResolution = m_updateResolutionBegin;
+        changed = true;
     } else if (m_inputTimers[0].check(eventHandler->keyHolded(e172::ScancodeEquals))) {
         m_zoom /= 0.9;
-        m_updateResolution = m_updateResolutionBegin;
+        changed = true;
     }
 
     if (m_inputTimers[1].check(eventHandler->keyHolded(e172::ScancodeLeft))) {
         m_offset.decrementX(0.1 / m_zoom);
-        m_updateResolution = m_updateResolutionBegin;
+        changed = true;
     } else if (m_inputTimers[1].check(eventHandler->keyHolded(e172::ScancodeRight))) {
         m_offset.incrementX(0.1 / m_zoom);
-        m_updateResolution = m_updateResolutionBegin;
+        changed = true;
     }
 
     if (m_inputTimers[2].check(eventHandler->keyHolded(e172::ScancodeUp))) {
         m_offset.decrementY(0.1 / m_zoom);
-        m_updateResolution = m_updateResolutionBegin;
+        changed = true;
     } else if (m_inputTimers[2].check(eventHandler->keyHolded(e172::ScancodeDown))) {
         m_offset.incrementY(0.1 / m_zoom);
-        m_updateResolution = m_updateResolutionBegin;
+        changed = true;
+    }
+
+    if (changed) {
+        if (m_latencyProbe) {
+            m_latencyProbe->input();
+        }
+        m_prefetcher->preempt();
+        m_adoptedFrame = m_prefetcher->take({m_offset, m_zoom});
+        if (m_adoptedFrame) {
+            m_deterioration = 0;
+        } else {
+            restartRefinement();
+        }
     }
 }
 
 void FractalView::render(e172::Context *, e172::AbstractRenderer *renderer)
 {
-    if(m_resolution < m_updateResolutionBegin) {
-        return;
-    }
-
-    if(m_updateResolution <= m_resolution) {
+    if (m_adoptedFrame) {
+        renderer->setAutoClear(false);
+        renderer->modifyBitmap([this, renderer](e172::Color *bitmap) {
+            TraceScope scope("blit");
+            const auto bmw = renderer->resolution().size_tX();
+            const auto w = std::min(m_resolution, bmw);
+            const auto h = std::min(m_resolution, renderer->resolution().size_tY());
+            for (size_t y = 0; y < h; ++y) {
+                const auto row = m_adoptedFrame->begin() + y * m_resolution;
+                std::copy(row, row + w, bitmap + y * bmw);
+            }
+        });
+        m_adoptedFrame.reset();
+        drawInfo(renderer, expRoof(m_depthMultiplier * m_zoom), 1);
+        if (m_latencyProbe) {
+            m_latencyProbe->frame(true);
+        }
+        schedulePrefetch();
+    } else if (m_deterioration > 0) {
         renderer->setAutoClear(false);
         //renderer->fill(0);
         const size_t depth = expRoof(m_depthMultiplier * m_zoom);
         //const size_t depth = m_depthMultiplier * (zoom > 1 ? std::sqrt(zoom) : zoom);
 
-        const auto deteriorationCoef = m_resolution / m_updateResolution;
-        if (deteriorationCoef == 0) {
-            std::cout << "deterioration_coef is 0. " << std::to_string(m_resolution) << " / " << std::to_string(m_updateResolution) << std::endl;
-            return;
-        }
-        if(m_updateResolution > 0) {
-            const size_t w = m_resolution;
-            const size_t h = m_resolution;
+        const auto deteriorationCoef = m_deterioration;
+        {
+            TraceScope passScope("pass", std::int64_t(deteriorationCoef));
+            const auto passBegin = std::chrono::steady_clock::now();
+            auto options = renderOptions();
+            options.deterioration = deteriorationCoef;
+            if (m_computeMode == ComputeMode::Auto && m_autoTuner) {
+                // a coarse pass computes one sample per block
+                options.backend = m_autoTuner->choose(m_resolution / deteriorationCoef, depth);
+            } else if (m_computeMode == ComputeMode::GPU) {
+                todo();
+            } else if (m_computeMode == ComputeMode::CPUConcurent) {
+                options.backend.kind = RenderBackend::Kind::ParallelStl;
+            }
 
-            renderer->modifyBitmap([this, renderer, w, h, depth, deteriorationCoef](
+            renderer->modifyBitmap([this, renderer, depth, deteriorationCoef, &options](
                                        e172::Color *bitmap) {
+                // pass minus compute is the modifyBitmap overhead
+                TraceScope computeScope("compute", std::int64_t(deteriorationCoef));
                 const auto bmw = renderer->resolution().size_tX();
-                const auto bms = bmw * renderer->resolution().size_tY();
-
-                const auto find_rem = [deteriorationCoef](size_t x) -> size_t {
-                    return x - x % deteriorationCoef;
-                };
-
-                const auto exec_line = [bitmap, bmw, bms, this, h, w, depth, find_rem](size_t y) {
-                    const auto rem_y = find_rem(y);
-                    for(size_t x = 0; x < w; ++x) {
-                        const auto rem_x = find_rem(x);
-                        auto i = y * bmw + x;
-                        auto ri = rem_y * bmw + rem_x;
-                        if(i >= 0 && i < bms) {
-                            if(rem_x == x && rem_y == y) {
-                                const auto &value = e172::Vector(double(x) / double(w) * 2 - 1,
-                                                                 double(y) / double(h) * 2 - 1)
-                                                        / m_zoom
-                                                    + m_offset;
-                                const auto level = e172::Math::fractalLevel(value.toComplex(), depth, m_function);
-                                const auto coef = double(level) / double(depth);
-
-                                const auto c = e172::Color(m_colorMask * coef);
-                                if(i == 0) {
-                                    std::cout << "D: " << std::dec << depth << ", L: " << level << ", DD: " << (double(level) / double(depth)) << ", c: " << std::hex << c << "\n";
-                                }
-
-                                bitmap[i] = e172::blend(c, m_backgroundColor);
-                            } else {
-                                bitmap[i] = bitmap[ri];
-                            }
-                        }
-                    }
-                };
-                std::cout << "ccc: " << toString(m_computeMode) << "\n";
-
-                if (m_computeMode == ComputeMode::GPU) {
-                    todo();
-                } else if (m_computeMode == ComputeMode::CPUConcurent) {
-                    std::vector<size_t> job(h);
-                    for(size_t y = 0; y < h; ++y) {
-                        job[y] = y;
-                    }
-                    std::for_each(std::execution::par_unseq, job.begin(), job.end(), exec_line);
-                } else {
-                    for(size_t y = 0; y < h; ++y) {
-                        exec_line(y);
-                    }
-                }
+                const auto bmh = renderer->resolution().size_tY();
+                // the part of the frame which does not fit the bitmap is clipped
+                ::render({m_offset, m_zoom},
+                         m_function,
+                         depth,
+                         options,
+                         {.pixels = {bitmap, bmw * bmh},
+                          .width = m_resolution,
+                          .height = m_resolution,
+                          .stride = bmw,
+                          .region = {.w = std::min(m_resolution, bmw),
+                                     .h = std::min(m_resolution, bmh)}});
             });
+            m_governor.record(FrameGovernor::samples(m_resolution, deteriorationCoef),
+                              depth,
+                              std::chrono::duration<double, std::milli>(
+                                  std::chrono::steady_clock::now() - passBegin)
+                                  .count());
         }
 
-        const auto xyz_string = "{ " + std::to_string(m_offset.x()) + ", "
-                                + std::to_string(m_offset.y()) + ", " + std::to_string(m_zoom)
-                                + " }";
-        const auto depth_string = "\nDepth: " + std::to_string(depth)
-                                  + " Deterioration: " + std::to_string(deteriorationCoef);
-        if(xyz_string.size() > 0) {
-            std::cout << "r/ss: " << m_resolution << " / " << xyz_string.size() << "\n";
-            renderer->drawString(xyz_string + depth_string, { 8, 8. }, 0xffffff, e172::TextFormat::fromFontSize(m_resolution / xyz_string.size()));
+        drawInfo(renderer, depth, deteriorationCoef);
+        m_deterioration = m_governor.nextDeterioration(m_resolution, deteriorationCoef, depth);
+        if (m_latencyProbe) {
+            m_latencyProbe->frame(m_deterioration == 0);
+        }
+        if (m_deterioration == 0) {
+            schedulePrefetch();
         }
-        m_updateResolution *= 2;
     }
 }
@@ -1,5 +1,14 @@
 #pragma once
 
+#include "autotuner.h"
+#include "escapetime.h"
+#include "framegovernor.h"
+#include "inputreplay.h"
+#include "latencyprobe.h"
+#include "prefetcher.h"
+#include "renderengine.h"
+#include "symmetry.h"
+
 #include <e172/entity.h>
 #include <e172/graphics/abstractrenderer.h>
 #include <e172/math/math.h>
@@ -8,7 +17,7 @@
 
 class FractalView : public e172::Entity {
 public:
-    enum class ComputeMode { CPU, CPUConcurent, GPU };
+    enum class ComputeMode { CPU, CPUConcurent, GPU, Auto };
 
     static std::string toString(ComputeMode computeMode);
 
@@ -45,30 +54,78 @@ public:
         e172::Color colorMask,
         e172::Color backgroundColor,
         const e172::ComplexFunction<double> &function = e172::Math::sqr<e172::Complex<double>>,
-        ComputeMode computeMode = ComputeMode::CPU);
+        const Symmetry &symmetry = {.conjugate = true},
+        const JuliaParameter &julia = std::nullopt,
+        const DistanceEstimation &distance = {},
+        ComputeMode computeMode = ComputeMode::CPU,
+        std::size_t targetFps = 30,
+        std::shared_ptr<const AutoTuner> autoTuner = nullptr,
+        std::shared_ptr<InputRecorder> inputRecorder = nullptr,
+        std::shared_ptr<LatencyProbe> latencyProbe = nullptr);
 
     ComputeMode computeMode() const;
 
+    /**
+     * @brief maxDeterioration - pixel block size of the coarsest refinement pass
+     */
+    static constexpr std::size_t maxDeterioration = 64;
+
+    /**
+     * @brief prefetchCapacity - number of idle-time precomputed neighbour frames kept
+     */
+    static constexpr std::size_t prefetchCapacity = 12;
+
+    /**
+     * @brief controlKeys - keys read by proceed (recorded by InputRecorder)
+     */
+    static constexpr e172::Scancode controlKeys[] = {e172::ScancodeMinus,
+                                                     e172::ScancodeEquals,
+                                                     e172::ScancodeLeft,
+                                                     e172::ScancodeRight,
+                                                     e172::ScancodeUp,
+                                                     e172::ScancodeDown};
+
     // Entity interface
 public:
     void proceed(e172::Context *, e172::EventHandler *eventHandler) override;
     void render(e172::Context *, e172::AbstractRenderer *renderer) override;
 
+private:
+    RenderOptions renderOptions() const;
+    void restartRefinement();
+    void schedulePrefetch();
+    bool prefetchFrame(const Prefetcher::Viewport &viewport,
+                       e172::Color *frame,
+                       const std::atomic<bool> &preempted) const;
+    void drawInfo(e172::AbstractRenderer *renderer, size_t depth, size_t deteriorationCoef);
+
 private:
     e172::ComplexFunction<double> m_function;
+    Symmetry m_symmetry;
+    JuliaParameter m_julia;
+    DistanceEstimation m_distance;
     e172::Color m_colorMask, m_backgroundColor;
 
     ComputeMode m_computeMode;
+    /// picks backend of every pass in ComputeMode::Auto
+    std::shared_ptr<const AutoTuner> m_autoTuner;
     size_t m_resolution;
     size_t m_depthMultiplier;
 
     e172::Vector<double> m_offset;
     double m_zoom = 0.5;
 
-    size_t m_updateResolutionBegin;
-    size_t m_updateResolution;
+    FrameGovernor m_governor;
+    /// block size of the next refinement pass. 0 when the view is at full quality
+    size_t m_deterioration;
 
     std::vector<e172::ElapsedTimer> m_inputTimers;
+    std::shared_ptr<InputRecorder> m_inputRecorder;
+    std::shared_ptr<LatencyProbe> m_latencyProbe;
+
+    Prefetcher::Frame m_adoptedFrame;
+    /// declared last - its worker uses the members above
+    std::unique_ptr<Prefetcher> m_prefetcher;
 };
 
 inline e172::Either<e172::FlagParseError, FractalView::ComputeMode> operator>>(
@@ -80,6 +137,8 @@ inline e172::Either<e172::FlagParseError, FractalView::ComputeMode> operator>>(
         return e172::Right(FractalView::ComputeMode::CPUConcurent);
     } else if (raw.str == "gpu") {
         return e172::Right(FractalView::ComputeMode::GPU);
+    } else if (raw.str == "auto") {
+        return e172::Right(FractalView::ComputeMode::Auto);
     } else {
         return e172::Left(e172::FlagParseError::EnumValueNotFound);
     }
@@ -0,0 +1,81 @@
+#include "framegovernor.h"
+
+#include <algorithm>
+
+namespace {
+
+/// share of the frame left for computing (the rest is blit and text)
+constexpr double computeShare = 0.75;
+
+/// weight of the newest measurement in the moving average
+constexpr double smoothing = 0.5;
+
+} // namespace
+
+FrameGovernor::FrameGovernor(double frameBudgetMs, std::size_t maxDeterioration)
+    : m_frameBudget(frameBudgetMs)
+    , m_maxDeterioration(std::max<std::size_t>(maxDeterioration, 1))
+{}
+
+void FrameGovernor::record(std::size_t samples, std::size_t depth, double elapsedMs)
+{
+    if (samples == 0 || depth == 0) {
+        return;
+    }
+    const auto cost = elapsedMs / double(samples);
+    if (m_costDepth == 0) {
+        m_costPerSample = cost;
+    } else {
+        // bring the old estimate to the new depth before averaging
+        const auto scaled = m_costPerSample * double(depth) / double(m_costDepth);
+        m_costPerSample = scaled + (cost - scaled) * smoothing;
+    }
+    m_costDepth = depth;
+}
+
+double FrameGovernor::predict(std::size_t resolution,
+                              std::size_t deterioration,
+                              std::size_t depth) const
+{
+    if (m_costDepth == 0) {
+        return 0;
+    }
+    return double(samples(resolution, deterioration)) * m_costPerSample * double(depth)
+           / double(m_costDepth);
+}
+
+std::size_t FrameGovernor::startDeterioration(std::size_t resolution, std::size_t depth) const
+{
+    if (m_costDepth == 0) {
+        return m_maxDeterioration;
+    }
+    return finestFitting(resolution, m_maxDeterioration, depth);
+}
+
+std::size_t FrameGovernor::nextDeterioration(std::size_t resolution,
+                                             std::size_t current,
+                                             std::size_t depth) const
+{
+    if (current <= 1) {
+        return 0;
+    }
+    return finestFitting(resolution, current / 2, depth);
+}
+
+std::size_t FrameGovernor::samples(std::size_t resolution, std::size_t deterioration)
+{
+    const auto side = (resolution + deterioration - 1) / deterioration;
+    return side * side;
+}
+
+std::size_t FrameGovernor::finestFitting(std::size_t resolution,
+                                         std::size_t from,
+                                         std::size_t depth) const
+{
+    const auto budget = m_frameBudget * computeShare;
+    auto result = std::max<std::size_t>(from, 1);
+    while (result > 1 && predict(resolution, result / 2, depth) <= budget) {
+        result /= 2;
+    }
+    return result;
+}
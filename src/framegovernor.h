@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief The FrameGovernor class picks deterioration coefficients (pixel block sizes) of
+ * progressive refinement passes so that each pass fits the frame time budget.
+ * Cost of a pass is predicted from the measured cost per sample of recent passes.
+ */
+class FrameGovernor
+{
+public:
+    FrameGovernor(double frameBudgetMs, std::size_t maxDeterioration);
+
+    /**
+     * @brief record - feed measured duration of a pass
+     * @param samples - number of computed samples
+     * @param depth - fractal depth used by the pass
+     * @param elapsedMs - wall time of the pass
+     */
+    void record(std::size_t samples, std::size_t depth, double elapsedMs);
+
+    /**
+     * @brief predict - estimated duration in milliseconds of a pass with given coefficient
+     * @return 0 if no pass was measured yet
+     */
+    double predict(std::size_t resolution, std::size_t deterioration, std::size_t depth) const;
+
+    /**
+     * @brief startDeterioration - finest coefficient whose pass fits the budget
+     * (maxDeterioration until first measurement)
+     */
+    std::size_t startDeterioration(std::size_t resolution, std::size_t depth) const;
+
+    /**
+     * @brief nextDeterioration - finest coefficient below current whose pass fits the budget.
+     * Always refines at least by 2 so that rendering makes progress.
+     * @return 0 if current is already 1 (full quality)
+     */
+    std::size_t nextDeterioration(std::size_t resolution,
+                                  std::size_t current,
+                                  std::size_t depth) const;
+
+    static std::size_t samples(std::size_t resolution, std::size_t deterioration);
+
+private:
+    std::size_t finestFitting(std::size_t resolution,
+                              std::size_t from,
+                              std::size_t depth) const;
+
+private:
+    double m_frameBudget;
+    std::size_t m_maxDeterioration;
+    double m_costPerSample = 0;
+    std::size_t m_costDepth = 0;
+};
@@ -0,0 +1,105 @@
+#include "inputreplay.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+constexpr const char *recordMagic = "mandelbrot-input-1";
+
+} // namespace
+
+InputRecorder::InputRecorder(const std::string &path)
+    : m_stream(path)
+    , m_begin(std::chrono::steady_clock::now())
+{
+    m_stream << recordMagic << "\n";
+}
+
+void InputRecorder::sample(const e172::EventHandler *eventHandler,
+                           std::span<const e172::Scancode> keys)
+{
+    const auto timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - m_begin)
+                            .count();
+    for (const auto key : keys) {
+        const bool held = eventHandler->keyHolded(key);
+        auto it = std::find_if(m_held.begin(), m_held.end(), [key](const auto &h) {
+            return h.first == key;
+        });
+        if (it == m_held.end()) {
+            it = m_held.insert(m_held.end(), {key, false});
+        }
+        if (it->second != held) {
+            it->second = held;
+            m_stream << timeMs << " " << int(key) << " " << int(held) << "\n";
+        }
+    }
+    m_stream.flush();
+}
+
+ReplayEventProvider::ReplayEventProvider(std::vector<InputEvent> events,
+                                         std::shared_ptr<const LatencyProbe> probe)
+    : m_events(std::move(events))
+    , m_probe(std::move(probe))
+{
+    std::stable_sort(m_events.begin(), m_events.end(), [](const auto &a, const auto &b) {
+        return a.timeMs < b.timeMs;
+    });
+}
+
+std::optional<std::vector<InputEvent>> ReplayEventProvider::load(const std::string &path)
+{
+    std::ifstream stream(path);
+    std::string magic;
+    if (!std::getline(stream, magic) || magic != recordMagic) {
+        return std::nullopt;
+    }
+    std::vector<InputEvent> events;
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::int64_t timeMs;
+        int scancode;
+        int pressed;
+        if (!(fields >> timeMs >> scancode >> pressed)) {
+            return std::nullopt;
+        }
+        events.push_back({timeMs, e172::Scancode(scancode), pressed != 0});
+    }
+    return events;
+}
+
+std::optional<e172::Event> ReplayEventProvider::pullEvent()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (!m_begin) {
+        m_begin = now;
+    }
+    if (m_quit) {
+        return std::nullopt;
+    }
+
+    if (m_next < m_events.size()) {
+        const auto &event = m_events[m_next];
+        if (now - *m_begin < std::chrono::milliseconds(event.timeMs)) {
+            return std::nullopt;
+        }
+        ++m_next;
+        return event.pressed ? e172::Event::keyDown(event.scancode)
+                             : e172::Event::keyUp(event.scancode);
+    }
+
+    if (!m_exhausted) {
+        m_exhausted = now;
+    }
+    const auto settled = now - *m_exhausted >= settleDelay && (!m_probe || m_probe->idle());
+    if (settled || now - *m_exhausted >= settleTimeout) {
+        m_quit = true;
+        return e172::Event::quit();
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "latencyprobe.h"
+
+#include <chrono>
+#include <cstdint>
+#include <e172/abstracteventprovider.h>
+#include <e172/eventhandler.h>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The InputEvent struct - key press or release at time since start of the session
+ */
+struct InputEvent
+{
+    std::int64_t timeMs;
+    e172::Scancode scancode;
+    bool pressed;
+};
+
+/**
+ * @brief The InputRecorder class writes key state changes of an interactive session to a text
+ * file ("timeMs scancode pressed" per line) that ReplayEventProvider plays back
+ */
+class InputRecorder
+{
+public:
+    InputRecorder(const std::string &path);
+
+    bool isOpen() const { return m_stream.is_open() && bool(m_stream); }
+
+    /**
+     * @brief sample - records keys which changed state since the previous sample
+     */
+    void sample(const e172::EventHandler *eventHandler, std::span<const e172::Scancode> keys);
+
+private:
+    std::ofstream m_stream;
+    std::chrono::steady_clock::time_point m_begin;
+    std::vector<std::pair<e172::Scancode, bool>> m_held;
+};
+
+/**
+ * @brief The ReplayEventProvider class feeds recorded input into the application with the
+ * original timing. After the last event it waits at least settleDelay (so that the view picks
+ * up the event), then until the view reaches full quality (or settleTimeout passes) and emits
+ * quit
+ */
+class ReplayEventProvider : public e172::AbstractEventProvider
+{
+public:
+    static constexpr std::chrono::milliseconds settleDelay = std::chrono::milliseconds(500);
+    static constexpr std::chrono::seconds settleTimeout = std::chrono::seconds(10);
+
+    ReplayEventProvider(std::vector<InputEvent> events, std::shared_ptr<const LatencyProbe> probe);
+
+    /**
+     * @brief load - reads file written by InputRecorder
+     * @return empty if file is missing or malformed
+     */
+    static std::optional<std::vector<InputEvent>> load(const std::string &path);
+
+    std::size_t eventCount() const { return m_events.size(); }
+
+    // AbstractEventProvider interface
+public:
+    std::optional<e172::Event> pullEvent() override;
+
+private:
+    std::vector<InputEvent> m_events;
+    std::shared_ptr<const LatencyProbe> m_probe;
+    std::size_t m_next = 0;
+    std::optional<std::chrono::steady_clock::time_point> m_begin;
+    std::optional<std::chrono::steady_clock::time_point> m_exhausted;
+    bool m_quit = false;
+};
@@ -0,0 +1,249 @@
+#include "iterationfile.h"
+
+#include "escapetime.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using AlignedBuffer = std::unique_ptr<std::uint8_t, decltype(&std::free)>;
+
+AlignedBuffer alignedBuffer(std::size_t size)
+{
+    void *ptr = nullptr;
+    if (::posix_memalign(&ptr, IterationFile::Header::blockSize, size) != 0) {
+        return AlignedBuffer(nullptr, &std::free);
+    }
+    std::memset(ptr, 0, size);
+    return AlignedBuffer(static_cast<std::uint8_t *>(ptr), &std::free);
+}
+
+bool writeAll(int fd, const std::uint8_t *data, std::size_t size)
+{
+    while (size > 0) {
+        const auto written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string IterationFile::Header::functionName() const
+{
+    return std::string(function, strnlen(function, sizeof(function)));
+}
+
+void IterationFile::Header::setFunctionName(const std::string &name)
+{
+    std::memset(function, 0, sizeof(function));
+    std::memcpy(function, name.data(), std::min(name.size(), sizeof(function) - 1));
+}
+
+bool IterationFile::Header::valid() const
+{
+    return std::memcmp(magic, expectedMagic, sizeof(magic)) == 0
+           && (sampleFormat == SampleFormat::Level || sampleFormat == SampleFormat::Smooth)
+           && width > 0 && height > 0 && tileSize > 0 && depth > 0
+           && dataOffset >= sizeof(Header) && dataOffset % blockSize == 0;
+}
+
+IterationFile::~IterationFile()
+{
+    close();
+}
+
+bool IterationFile::open(const std::string &path)
+{
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    void *data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = static_cast<const std::uint8_t *>(data);
+    m_size = st.st_size;
+    m_header = reinterpret_cast<const Header *>(m_data);
+    if (!m_header->valid() || m_header->fileSize() > m_size) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void IterationFile::close()
+{
+    if (m_data) {
+        ::munmap(const_cast<std::uint8_t *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_header = nullptr;
+    m_size = 0;
+}
+
+const void *IterationFile::tile(std::uint64_t tx, std::uint64_t ty) const
+{
+    return m_data + m_header->dataOffset + (ty * m_header->tilesX() + tx) * m_header->tileBytes();
+}
+
+double IterationFile::level(std::uint64_t x, std::uint64_t y) const
+{
+    const auto tileSize = m_header->tileSize;
+    const auto *sample = static_cast<const std::uint8_t *>(tile(x / tileSize, y / tileSize))
+                         + ((y % tileSize) * tileSize + x % tileSize) * sizeof(std::uint32_t);
+    if (m_header->sampleFormat == SampleFormat::Smooth) {
+        float value;
+        std::memcpy(&value, sample, sizeof(value));
+        return value;
+    } else {
+        std::uint32_t value;
+        std::memcpy(&value, sample, sizeof(value));
+        return value;
+    }
+}
+
+e172::MatrixFiller<e172::Color> IterationFile::filler(e172::Color colorMask) const
+{
+    return [this, colorMask](std::size_t w, std::size_t h, e172::Color *bitmap) {
+        const auto width = std::min<std::uint64_t>(w, m_header->width);
+        const auto height = std::min<std::uint64_t>(h, m_header->height);
+        const auto depth = double(m_header->depth);
+        const auto tileSize = m_header->tileSize;
+        // walk tile by tile to read the mapping sequentially
+        for (std::uint64_t ty = 0; ty * tileSize < height; ++ty) {
+            for (std::uint64_t tx = 0; tx * tileSize < width; ++tx) {
+                TraceScope scope("color", std::int64_t(ty * m_header->tilesX() + tx));
+                for (auto y = ty * tileSize; y < std::min(height, (ty + 1) * tileSize); ++y) {
+                    for (auto x = tx * tileSize; x < std::min(width, (tx + 1) * tileSize); ++x) {
+                        bitmap[y * w + x] = e172::Color(colorMask * (level(x, y) / depth));
+                    }
+                }
+            }
+        }
+    };
+}
+
+bool IterationFile::write(const std::string &path,
+                          const Header &header,
+                          const e172::ComplexFunction<double> &function,
+                          const RenderBackend &backend)
+{
+    if (!header.valid()) {
+        return false;
+    }
+
+    constexpr int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = -1;
+#ifdef O_DIRECT
+    // bypass page cache when every write is block aligned
+    if (header.tileBytes() % Header::blockSize == 0) {
+        fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    }
+#endif
+    if (fd < 0) {
+        fd = ::open(path.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        return false;
+    }
+    // fail before rendering anything when the disk can not hold the file
+    if (::posix_fallocate(fd, 0, header.fileSize()) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    const auto headerBlock = alignedBuffer(header.dataOffset);
+    if (!headerBlock) {
+        ::close(fd);
+        return false;
+    }
+    std::memcpy(headerBlock.get(), &header, sizeof(header));
+    bool ok = writeAll(fd, headerBlock.get(), header.dataOffset);
+
+    const auto tileSize = header.tileSize;
+    const auto tileSamples = tileSize * tileSize;
+    const auto bandBytes = header.tilesX() * header.tileBytes();
+    AlignedBuffer buffers[] = {alignedBuffer(bandBytes), alignedBuffer(bandBytes)};
+    if (!buffers[0] || !buffers[1]) {
+        ::close(fd);
+        return false;
+    }
+
+    std::future<bool> pending;
+    for (std::uint64_t ty = 0; ok && ty < header.tilesY(); ++ty) {
+        auto *band = buffers[ty % 2].get();
+        if ((ty + 1) * tileSize > header.height) {
+            // padding rows of the last band
+            std::memset(band, 0, bandBytes);
+        }
+
+        const auto exec_line = [&](std::uint64_t y) {
+            if (y >= header.height) {
+                return;
+            }
+            TraceScope scope("row", std::int64_t(y));
+            const auto row = y % tileSize;
+            for (std::uint64_t x = 0; x < header.width; ++x) {
+                const auto &value = e172::Vector(double(x) / double(header.width) * 2 - 1,
+                                                 double(y) / double(header.height) * 2 - 1)
+                                        / header.zoom
+                                    + e172::Vector(header.offsetX, header.offsetY);
+                auto *sample = band
+                               + ((x / tileSize) * tileSamples + row * tileSize + x % tileSize)
+                                     * sizeof(std::uint32_t);
+                if (header.sampleFormat == SampleFormat::Smooth) {
+                    const auto level = float(
+                        escapeSmoothLevel(value.toComplex(), header.depth, function));
+                    std::memcpy(sample, &level, sizeof(level));
+                } else {
+                    const auto level = std::uint32_t(
+                        e172::Math::fractalLevel(value.toComplex(), header.depth, function));
+                    std::memcpy(sample, &level, sizeof(level));
+                }
+            }
+        };
+        const auto firstRow = ty * tileSize;
+        runRows(backend, tileSize, [firstRow, &exec_line](std::size_t i) {
+            exec_line(firstRow + i);
+        });
+
+        if (pending.valid()) {
+            ok = pending.get();
+        }
+        pending = std::async(std::launch::async, [fd, band, bandBytes, ty] {
+            TraceScope scope("band_write", std::int64_t(ty));
+            return writeAll(fd, band, bandBytes);
+        });
+    }
+    if (pending.valid()) {
+        ok = pending.get() && ok;
+    }
+    return ::close(fd) == 0 && ok;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "renderengine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <string>
+
+/**
+ * @brief The IterationFile class gives read access to a raw iteration data file via mmap.
+ *
+ * File layout (little endian, native):
+ *   [0, 4096)       Header
+ *   [dataOffset, ) tiles in row-major order, each tile is tileSize x tileSize samples in
+ *                   row-major order. Edge tiles are padded to full size, so tile (tx, ty)
+ *                   starts at dataOffset + (ty * tilesX + tx) * tileBytes.
+ * Sample is uint32 escape level (SampleFormat::Level) or float smooth level
+ * (SampleFormat::Smooth).
+ */
+class IterationFile
+{
+public:
+    enum class SampleFormat : std::uint32_t { Level = 0, Smooth = 1 };
+
+    struct Header
+    {
+        static constexpr char expectedMagic[8] = {'M', 'B', 'I', 'T', 'E', 'R', '0', '1'};
+        static constexpr std::uint64_t blockSize = 4096;
+
+        char magic[8] = {'M', 'B', 'I', 'T', 'E', 'R', '0', '1'};
+        SampleFormat sampleFormat = SampleFormat::Level;
+        std::uint32_t reserved = 0;
+        std::uint64_t width = 0;
+        std::uint64_t height = 0;
+        std::uint64_t tileSize = 64;
+        std::uint64_t depth = 0;
+        double offsetX = 0;
+        double offsetY = 0;
+        double zoom = 0.5;
+        std::uint64_t dataOffset = blockSize;
+        char function[64] = {};
+
+        std::uint64_t tilesX() const { return (width + tileSize - 1) / tileSize; }
+        std::uint64_t tilesY() const { return (height + tileSize - 1) / tileSize; }
+        std::uint64_t tileBytes() const { return tileSize * tileSize * sizeof(std::uint32_t); }
+        std::uint64_t fileSize() const { return dataOffset + tilesX() * tilesY() * tileBytes(); }
+        std::string functionName() const;
+        void setFunctionName(const std::string &name);
+        bool valid() const;
+    };
+
+    static_assert(sizeof(Header) <= Header::blockSize);
+
+    IterationFile() = default;
+    IterationFile(const IterationFile &) = delete;
+    IterationFile &operator=(const IterationFile &) = delete;
+    ~IterationFile();
+
+    /**
+     * @brief open - maps file read only
+     * @return false if file can not be mapped or has no valid header
+     */
+    bool open(const std::string &path);
+    void close();
+
+    const Header &header() const { return *m_header; }
+
+    const void *tile(std::uint64_t tx, std::uint64_t ty) const;
+
+    /**
+     * @brief level - sample at (x, y) converted to level in [0, depth]
+     */
+    double level(std::uint64_t x, std::uint64_t y) const;
+
+    /**
+     * @brief filler - colors levels like FractalView (colorMask * level / depth)
+     */
+    e172::MatrixFiller<e172::Color> filler(e172::Color colorMask) const;
+
+    /**
+     * @brief write - computes fractal of the viewport described by header band by band (one
+     * row of tiles) and writes it with large aligned sequential writes. Computing of the next
+     * band overlaps with writing of the previous one.
+     */
+    static bool write(const std::string &path,
+                      const Header &header,
+                      const e172::ComplexFunction<double> &function,
+                      const RenderBackend &backend);
+
+private:
+    const Header *m_header = nullptr;
+    const std::uint8_t *m_data = nullptr;
+    std::size_t m_size = 0;
+};
@@ -0,0 +1,127 @@
+#include "juliaatlas.h"
+
+#include "escapetime.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace {
+
+/// samples iterated together by the quadratic kernel (4 x AVX2 or 2 x AVX-512 registers)
+constexpr std::size_t laneCount = 16;
+
+/// iterations between checks whether the whole pack escaped
+constexpr std::size_t escapeCheckInterval = 8;
+
+/**
+ * @brief quadraticLevels - escape levels of z -> z^2 + c for laneCount starting points.
+ * Escaped lanes keep iterating (their values may overflow) but stop counting.
+ * Cloned for wide vector units, the best clone is picked at load time
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+void quadraticLevels(const double *zr0,
+                     const double *zi0,
+                     double cr,
+                     double ci,
+                     std::size_t depth,
+                     std::size_t *levels)
+{
+    double zr[laneCount];
+    double zi[laneCount];
+    std::size_t alive[laneCount];
+    for (std::size_t l = 0; l < laneCount; ++l) {
+        zr[l] = zr0[l];
+        zi[l] = zi0[l];
+        alive[l] = 1;
+        levels[l] = 0;
+    }
+    for (std::size_t i = 0; i < depth; i += escapeCheckInterval) {
+        const auto end = std::min(i + escapeCheckInterval, depth);
+        for (auto k = i; k < end; ++k) {
+            for (std::size_t l = 0; l < laneCount; ++l) {
+                const auto r = zr[l] * zr[l] - zi[l] * zi[l] + cr;
+                const auto m = 2 * zr[l] * zi[l] + ci;
+                zr[l] = r;
+                zi[l] = m;
+                alive[l] &= std::size_t(r * r + m * m <= 4);
+                levels[l] += alive[l];
+            }
+        }
+        std::size_t any = 0;
+        for (std::size_t l = 0; l < laneCount; ++l) {
+            any |= alive[l];
+        }
+        if (!any) {
+            break;
+        }
+    }
+}
+
+} // namespace
+
+e172::MatrixFiller<e172::Color> juliaAtlasFiller(std::size_t columns,
+                                                 std::size_t rows,
+                                                 std::size_t depth,
+                                                 e172::Color colorMask,
+                                                 const e172::ComplexFunction<double> &function,
+                                                 bool quadratic,
+                                                 const RenderBackend &backend)
+{
+    return [columns, rows, depth, colorMask, function, quadratic, backend](std::size_t w,
+                                                                           std::size_t h,
+                                                                           e172::Color *bitmap) {
+        const auto tw = std::max<std::size_t>(w / std::max<std::size_t>(columns, 1), 1);
+        const auto th = std::max<std::size_t>(h / std::max<std::size_t>(rows, 1), 1);
+        const auto color = [depth, colorMask](std::size_t level) {
+            return e172::Color(colorMask * (double(level) / double(depth)));
+        };
+
+        const auto exec_line = [&](std::size_t y) {
+            TraceScope scope("atlas_row", std::int64_t(y));
+            const auto row = y / th;
+            const auto ly = y % th;
+            auto *line = bitmap + y * w;
+            if (row >= rows) {
+                std::fill(line, line + w, e172::Color(0));
+                return;
+            }
+            // thumbnail coordinates as in FractalView at zoom 0.5
+            const auto zi = (double(ly) / double(th) * 2 - 1) * 2;
+            const auto ci = ((double(row) + 0.5) / double(rows) * 2 - 1) * 2;
+
+            double zrPack[laneCount];
+            double ziPack[laneCount];
+            std::size_t levels[laneCount];
+            for (std::size_t column = 0; column < columns; ++column) {
+                const auto cr = ((double(column) + 0.5) / double(columns) * 2 - 1) * 2;
+                auto *thumbnail = line + column * tw;
+                if (!quadratic) {
+                    const e172::Complex<double> c(cr, ci);
+                    for (std::size_t x = 0; x < tw; ++x) {
+                        const e172::Complex<double> z((double(x) / double(tw) * 2 - 1) * 2, zi);
+                        thumbnail[x] = color(escapeLevel(z, depth, function, c));
+                    }
+                    continue;
+                }
+                for (std::size_t x = 0; x < tw; x += laneCount) {
+                    const auto count = std::min(laneCount, tw - x);
+                    for (std::size_t l = 0; l < laneCount; ++l) {
+                        // tail lanes repeat the last sample
+                        const auto lx = x + std::min(l, count - 1);
+                        zrPack[l] = (double(lx) / double(tw) * 2 - 1) * 2;
+                        ziPack[l] = zi;
+                    }
+                    quadraticLevels(zrPack, ziPack, cr, ci, depth, levels);
+                    for (std::size_t l = 0; l < count; ++l) {
+                        thumbnail[x + l] = color(levels[l]);
+                    }
+                }
+            }
+            std::fill(line + columns * tw, line + w, e172::Color(0));
+        };
+
+        runRows(backend, h, exec_line);
+    };
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "renderengine.h"
+
+#include <cstddef>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+
+/**
+ * @brief juliaAtlasFiller - filler of a columns x rows mosaic of Julia set thumbnails.
+ * Thumbnail (col, row) shows the [-2, 2] x [-2, 2] plane of z -> f(z) + c where c is the center
+ * of cell (col, row) of the [-2, 2] x [-2, 2] parameter plane, so the mosaic is a map of the
+ * Mandelbrot set. Thumbnail size is w / columns x h / rows.
+ * All thumbnails are rendered as one job: mosaic rows are spread across threads by
+ * backend, every row is iterated in packs of lanes. For f(z) = z^2 (quadratic) the pack is
+ * iterated with plain double arithmetic that the compiler vectorizes
+ */
+e172::MatrixFiller<e172::Color> juliaAtlasFiller(std::size_t columns,
+                                                 std::size_t rows,
+                                                 std::size_t depth,
+                                                 e172::Color colorMask,
+                                                 const e172::ComplexFunction<double> &function,
+                                                 bool quadratic,
+                                                 const RenderBackend &backend);
@@ -0,0 +1,64 @@
+#include "latencyprobe.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+
+namespace {
+
+void reportDistribution(std::ostream &stream, const char *name, const std::vector<double> &values)
+{
+    stream << "  " << name << ": n=" << values.size() << " p50=" << percentile(values, 0.5)
+           << " p90=" << percentile(values, 0.9) << " p99=" << percentile(values, 0.99) << " max="
+           << (values.empty() ? 0 : *std::max_element(values.begin(), values.end())) << " ms"
+           << std::endl;
+}
+
+} // namespace
+
+void LatencyProbe::input()
+{
+    std::lock_guard lock(m_mutex);
+    const auto now = Clock::now();
+    if (m_pendingFullQuality) {
+        ++m_superseded;
+    }
+    // the first frame of a burst of input answers its oldest unanswered event
+    if (!m_pendingFirstFrame) {
+        m_pendingFirstFrame = now;
+    }
+    m_pendingFullQuality = now;
+}
+
+void LatencyProbe::frame(bool fullQuality)
+{
+    std::lock_guard lock(m_mutex);
+    const auto now = Clock::now();
+    const auto ms = [now](Clock::time_point begin) {
+        return std::chrono::duration<double, std::milli>(now - begin).count();
+    };
+    if (m_pendingFirstFrame) {
+        m_firstFrame.push_back(ms(*m_pendingFirstFrame));
+        m_pendingFirstFrame.reset();
+    }
+    if (fullQuality && m_pendingFullQuality) {
+        m_fullQuality.push_back(ms(*m_pendingFullQuality));
+        m_pendingFullQuality.reset();
+    }
+}
+
+bool LatencyProbe::idle() const
+{
+    std::lock_guard lock(m_mutex);
+    return !m_pendingFirstFrame && !m_pendingFullQuality;
+}
+
+void LatencyProbe::report(std::ostream &stream) const
+{
+    std::lock_guard lock(m_mutex);
+    stream << "Input latency {" << std::endl;
+    reportDistribution(stream, "input to first frame", m_firstFrame);
+    reportDistribution(stream, "input to full quality", m_fullQuality);
+    stream << "  superseded before full quality: " << m_superseded << std::endl
+           << "}" << std::endl;
+}
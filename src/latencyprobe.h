@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief The LatencyProbe class measures how fast the interactive view answers input.
+ * For every input that changes the viewport it records time until the first frame of the new
+ * viewport and time until that viewport reaches full quality. Input that arrives before full
+ * quality supersedes the pending one (its full quality latency is not recorded).
+ */
+class LatencyProbe
+{
+public:
+    /**
+     * @brief input - viewport was changed by input
+     */
+    void input();
+
+    /**
+     * @brief frame - frame was presented
+     * @param fullQuality - true if no refinement pass follows
+     */
+    void frame(bool fullQuality);
+
+    /**
+     * @brief idle - no input waits for full quality
+     */
+    bool idle() const;
+
+    /**
+     * @brief report - p50, p90, p99 and max of both distributions in milliseconds
+     */
+    void report(std::ostream &stream) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    mutable std::mutex m_mutex;
+    std::optional<Clock::time_point> m_pendingFirstFrame;
+    std::optional<Clock::time_point> m_pendingFullQuality;
+    std::size_t m_superseded = 0;
+    std::vector<double> m_firstFrame;
+    std::vector<double> m_fullQuality;
+};
@@ -1,6 +1,17 @@
+#include "autotuner.h"
+#include "complexfunctions.h"
 #include "flags.h"
 #include "fractalview.h"
+#include "inputreplay.h"
+#include "iterationfile.h"
+#include "juliaatlas.h"
+#include "latencyprobe.h"
+#include "orbitdensityview.h"
+#include "renderengine.h"
+#include "renderjournal.h"
 #include "test.h"
+#include "tileserver.h"
+#include "trace.h"
 #include <e172/additional.h>
 #include <e172/gameapplication.h>
 #include <e172/graphics/imageview.h>
@@ -9,19 +20,22 @@
 #include <e172/impl/sdl/graphicsprovider.h>
 #include <e172/impl/vulkan/graphicsprovider.h>
 #include <e172/math/math.h>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <thread>
 
 bool generateFractalImageFile(std::shared_ptr<e172::AbstractGraphicsProvider> graphicsProvider,
                               const std::string &path,
-                              size_t N,
+                              size_t w,
+                              size_t h,
                               e172::MatrixFiller<e172::Color> fractal,
                               e172::Color backgroundColor)
 {
-    return (graphicsProvider->createImage(N, N, e172::Math::filler(backgroundColor))
-            + graphicsProvider->createImage(N, N, fractal)
-            ).save(path);
+    auto image = graphicsProvider->createImage(w, h, e172::Math::filler(backgroundColor))
+                 + graphicsProvider->createImage(w, h, fractal);
+    TraceScope scope("encode");
+    return image.save(path);
 }
 
 bool generateFractalImageFile(std::shared_ptr<e172::AbstractGraphicsProvider> graphicsProvider,
@@ -33,64 +47,34 @@ bool generateFractalImageFile(std::shared_ptr<e172::AbstractGraphicsProvider> gr
     return generateFractalImageFile(std::move(graphicsProvider),
                                     "./fractal" + std::to_string(N) + description + ".png",
                                     N,
+                                    N,
                                     fractal,
                                     backgroundColor);
 }
 
+/// write mode renders of at least this resolution are checkpointed to a journal
+constexpr std::uint32_t journaledResolution = 2048;
+
 int main(int argc, const char **argv)
 {
     e172::GameApplication app(argc, argv);
 
-    // complex functions
-    const std::map<std::string, e172::ComplexFunction<double>> complexFunctions
-        = {{"x", [](const auto &x) { return x; }},
-           {"sqr", e172::Math::sqr<e172::Complex<double>>},
-           {"sin", [](const auto &x) { return std::sin(x); }},
-           {"cos", [](const auto &x) { return std::cos(x); }},
-           {"sin_sqr", [](const auto &x) { return std::sin(x * x); }},
-           {"cos_sqr", [](const auto &x) { return std::cos(x * x); }},
-           {"tan_sqr", [](const auto &x) { return std::tan(x * x); }},
-           {"asin_sqr", [](const auto &x) { return std::asin(x * x); }},
-           {"log_sqr", [](const auto &x) { return std::log(x * x); }},
-           {"exp_sqr", [](const auto &x) { return std::exp(x * x); }},
-           {"sigm_sqr", [](const auto &x) { return e172::Math::sigm(x * x); }},
-           {"floor2_sqr",
-            [](const auto &x) {
-                const auto t = x * x * 2.;
-                return e172::Complex<double>{std::floor(t.real()), std::floor(t.imag())} / 2.;
-            }},
-           {"floor4_sqr",
-            [](const auto &x) {
-                const auto t = x * x * 4.;
-                return e172::Complex<double>{std::floor(t.real()), std::floor(t.imag())} / 4.;
-            }},
-           {"floor8_sqr",
-            [](const auto &x) {
-                const auto t = x * x * 8.;
-                return e172::Complex<double>{std::floor(t.real()), std::floor(t.imag())} / 8.;
-            }},
-           {"floor16_sqr",
-            [](const auto &x) {
-                const auto t = x * x * 16.;
-                return e172::Complex<double>{std::floor(t.real()), std::floor(t.imag())} / 16.;
-            }},
-           {"floor32_sqr",
-            [](const auto &x) {
-                const auto t = x * x * 32.;
-                return e172::Complex<double>{std::floor(t.real()), std::floor(t.imag())} / 32.;
-            }},
-           {"sgn_sqr", [](const auto &x) { return e172::Math::sgn(x * x); }}};
-
-    const std::string defaultComplexFunctionName = "sqr";
-    const auto flags = Flags::parse(argc, argv, defaultComplexFunctionName);
+    const auto flags = Flags::parse(argc, argv, defaultComplexFunctionName());
+    // written when main returns
+    const TraceSession traceSession(flags.trace);
 
     if (flags.funcList) {
         std::cout << "Available complex functions:" << std::endl;
-        for(const auto& cf : complexFunctions) {
-            std::cout << "  " << cf.first << (cf.second.operator bool() ? "" : " (invalid)")
-                      << std::endl;
+        for (const auto &cf : complexFunctions()) {
+            std::cout << "  " << cf.first
+                      << (cf.second.function.operator bool() ? "" : " (invalid)")
+                      << (cf.second.symmetry.conjugate ? " [conjugate]" : "")
+                      << (cf.second.symmetry.rotation > 1
+                              ? " [rotation " + std::to_string(cf.second.symmetry.rotation) + "]"
+                              : "")
+                      << (cf.second.derivative ? " [distance]" : "") << std::endl;
         }
-        std::cout << "Default complex function: " << defaultComplexFunctionName << "\n";
+        std::cout << "Default complex function: " << defaultComplexFunctionName() << "\n";
         return 0;
     }
 
@@ -101,9 +85,9 @@ int main(int argc, const char **argv)
         return 0;
     }
 
-    const auto complexFunction = [&complexFunctions, &flags] {
-        const auto it = complexFunctions.find(flags.function);
-        if (it != complexFunctions.end()) {
+    const auto complexFunctionEntry = [&flags] {
+        const auto it = complexFunctions().find(flags.function);
+        if (it != complexFunctions().end()) {
             return it->second;
         } else {
             std::cerr << "error: Complex function with name '" << flags.function
@@ -111,6 +95,17 @@ int main(int argc, const char **argv)
             std::exit(2);
         }
     }();
+    const auto &complexFunction = complexFunctionEntry.function;
+    if (flags.distance && !complexFunctionEntry.derivative) {
+        std::cerr << "error: Distance estimation needs a holomorphic function, '" << flags.function
+                  << "' has no derivative.\n";
+        return 2;
+    }
+    DistanceEstimation distance;
+    if (flags.distance) {
+        distance = {.derivative = complexFunctionEntry.derivative,
+                    .fillExterior = complexFunctionEntry.polynomial};
+    }
 
     std::map<GraphicsProvider,
              std::function<std::shared_ptr<e172::AbstractGraphicsProvider>(const std::string &)>>
@@ -188,6 +183,128 @@ int main(int argc, const char **argv)
 
     const auto providerFactory = providerFactories.at(flags.graphicsProvider);
 
+    // tile server mode
+    if (flags.serveMode) {
+        if (flags.port == 0 || flags.port > 65535) {
+            std::cerr << "error: Invalid port " << flags.port << ".\n";
+            return 1;
+        }
+        TileServer server(complexFunction,
+                          TileServer::Settings{
+                              .port = static_cast<std::uint16_t>(flags.port),
+                              .workerCount = flags.workers,
+                              .queueCapacity = std::max<std::size_t>(flags.queueSize, 1),
+                              .cacheDir = flags.tileCache,
+                              .functionName = flags.function,
+                              .depthMultiplier = flags.depth,
+                              .colorMask = flags.colorMask,
+                              .backgroundColor = flags.backgroundColor,
+                          });
+        return server.exec();
+    }
+
+    // colorize raw iteration data
+    if (!flags.colorize.empty()) {
+        IterationFile file;
+        if (!file.open(flags.colorize)) {
+            std::cerr << "error: '" << flags.colorize << "' is not an iteration data file.\n";
+            return 1;
+        }
+        const auto &header = file.header();
+        const auto path = std::filesystem::path(flags.colorize).replace_extension(".png").string();
+        std::cout << "Colorize " << header.width << "x" << header.height
+                  << " (function: " << header.functionName() << ", depth: " << header.depth
+                  << ") to " << path << std::endl;
+        if (!generateFractalImageFile(providerFactory({}),
+                                      path,
+                                      header.width,
+                                      header.height,
+                                      file.filler(flags.colorMask),
+                                      flags.backgroundColor)) {
+            std::cerr << "error: Can not write '" << path << "'.\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    // compute backend table is measured on first use and stored per host and function
+    std::shared_ptr<AutoTuner> autoTuner;
+    if (flags.computeMode == FractalView::ComputeMode::Auto) {
+        autoTuner = std::make_shared<AutoTuner>(AutoTuner::defaultPath(flags.function),
+                                                complexFunction);
+        autoTuner->loadOrCalibrate(std::cout);
+    }
+    // image fillers have no GPU path, so GPU falls back to serial
+    const auto chooseBackend = [&flags, &autoTuner]() -> RenderBackend {
+        switch (flags.computeMode) {
+        case FractalView::ComputeMode::CPU:
+        case FractalView::ComputeMode::GPU:
+            return {.kind = RenderBackend::Kind::Serial};
+        case FractalView::ComputeMode::CPUConcurent:
+            return {.kind = RenderBackend::Kind::ParallelStl};
+        case FractalView::ComputeMode::Auto:
+            if (autoTuner && std::holds_alternative<std::uint32_t>(flags.resolution)) {
+                const auto backend = autoTuner->choose(std::get<std::uint32_t>(flags.resolution),
+                                                       flags.depth);
+                std::cout << "Auto compute mode: " << backend.toString() << std::endl;
+                return backend;
+            }
+            return {.kind = RenderBackend::Kind::Serial};
+        }
+        return {.kind = RenderBackend::Kind::Serial};
+    };
+
+    // julia atlas
+    if (flags.atlas.columns > 0) {
+        const auto width = std::get<std::uint32_t>(flags.resolution);
+        const auto thumbnailSize = width / flags.atlas.columns;
+        if (thumbnailSize == 0) {
+            std::cerr << "error: Resolution " << width << " is less than atlas width "
+                      << flags.atlas.columns << ".\n";
+            return 1;
+        }
+        const auto height = thumbnailSize * flags.atlas.rows;
+        const auto path = "./atlas" + std::to_string(flags.atlas.columns) + "x"
+                          + std::to_string(flags.atlas.rows) + "S"
+                          + std::to_string(thumbnailSize) + "D" + std::to_string(flags.depth)
+                          + "F" + flags.function + ".png";
+        std::cout << "Julia atlas " << flags.atlas << " of " << thumbnailSize << "x"
+                  << thumbnailSize << " thumbnails (function: " << flags.function
+                  << ", depth: " << flags.depth << ")" << std::endl;
+
+        if (flags.computeMode == FractalView::ComputeMode::GPU) {
+            std::cout << "Warning: graphical compute mode not alloved in atlas mode. Used simple\n";
+        }
+        const auto backend = chooseBackend();
+        e172::ElapsedTimer timer;
+        const auto graphicsProvider = providerFactory({});
+        const auto atlas = juliaAtlasFiller(flags.atlas.columns,
+                                            flags.atlas.rows,
+                                            flags.depth,
+                                            flags.colorMask,
+                                            complexFunction,
+                                            complexFunctionEntry.quadratic,
+                                            backend);
+        auto image = graphicsProvider->createImage(width,
+                                                   height,
+                                                   e172::Math::filler(flags.backgroundColor))
+                     + graphicsProvider->createImage(width, height, atlas);
+        TraceScope encodeScope("encode");
+        if (!image.save(path)) {
+            std::cerr << "error: Can not write '" << path << "'.\n";
+            return 1;
+        }
+        std::cout << "Written: " << path << "\nElapsed: " << timer.elapsed() << " ms."
+                  << std::endl;
+        return 0;
+    }
+
+    const auto julia = flags.julia.parameter();
+    const auto juliaSuffix = julia ? "J" + std::to_string(flags.julia.re) + ","
+                                         + std::to_string(flags.julia.im)
+                                   : std::string();
+    const auto nameSuffix = juliaSuffix + (flags.distance ? "E" : "");
+
     //write flag
     if (flags.writeMode) {
         std::cout << "Write mode." << std::endl;
@@ -198,7 +315,10 @@ int main(int argc, const char **argv)
                   << "\t\"background color\": 0x" << std::hex << flags.backgroundColor << ","
                   << std::endl
                   << "\t\"depth\": " << std::dec << flags.depth << "," << std::endl
-                  << "\t\"compute mode\": " << FractalView::toString(flags.computeMode) << std::endl
+                  << "\t\"compute mode\": " << FractalView::toString(flags.computeMode) << ","
+                  << std::endl
+                  << "\t\"julia\": " << flags.julia << "," << std::endl
+                  << "\t\"distance\": " << (flags.distance ? "true" : "false") << std::endl
                   << "}" << std::endl
                   << std::endl
                   << "Started. Please wait." << std::endl;
@@ -207,17 +327,146 @@ int main(int argc, const char **argv)
         if (flags.computeMode == FractalView::ComputeMode::GPU) {
             std::cout << "Warning: graphical compute mode not alloved in write mode. Used simple\n";
         }
-        const bool concurent = flags.computeMode == FractalView::ComputeMode::CPUConcurent;
+        const auto backend = chooseBackend();
+        if (flags.orbitDensity != OrbitDensity::Mode::None) {
+            const auto resolution = std::get<std::uint32_t>(flags.resolution);
+            OrbitDensity density(complexFunction,
+                                 OrbitDensity::Settings{.width = resolution,
+                                                        .height = resolution,
+                                                        .depth = flags.depth,
+                                                        .mode = flags.orbitDensity});
+            std::size_t reported = 0;
+            while (density.samples() < flags.samples) {
+                density.round();
+                const auto percent = density.samples() * 100
+                                     / std::max<std::size_t>(flags.samples, 1);
+                if (percent / 10 != reported / 10) {
+                    std::cout << std::min<std::size_t>(percent, 100) << "%" << std::endl;
+                    reported = percent;
+                }
+            }
+            generateFractalImageFile(
+                providerFactory({}),
+                resolution,
+                [&density, &flags](std::size_t w, std::size_t h, e172::Color *bitmap) {
+                    density.image(w, h, bitmap, flags.colorMask, flags.backgroundColor);
+                },
+                "D" + std::to_string(flags.depth) + "F" + flags.function
+                    + OrbitDensity::toString(flags.orbitDensity),
+                flags.backgroundColor);
+            std::cout << "Finished.\nElapsed: " << timer.elapsed() << " ms." << std::endl;
+            return 0;
+        }
+        if (flags.outputFormat != OutputFormat::PNG) {
+            if (julia || flags.distance) {
+                std::cerr << "error: Raw iteration data of Julia sets and distance estimation is "
+                             "not supported.\n";
+                return 1;
+            }
+            IterationFile::Header header;
+            header.sampleFormat = flags.outputFormat == OutputFormat::Smooth
+                                      ? IterationFile::SampleFormat::Smooth
+                                      : IterationFile::SampleFormat::Level;
+            header.width = std::get<std::uint32_t>(flags.resolution);
+            header.height = header.width;
+            header.depth = flags.depth;
+            header.setFunctionName(flags.function);
+            const auto path = "./fractal" + std::to_string(header.width) + "D"
+                              + std::to_string(flags.depth) + "F" + flags.function + "."
+                              + toString(flags.outputFormat) + ".mbi";
+            if (!IterationFile::write(path, header, complexFunction, backend)) {
+                std::cerr << "error: Can not write '" << path << "'.\n";
+                return 1;
+            }
+            std::cout << "Written: " << path << "\nFinished.\nElapsed: " << timer.elapsed()
+                      << " ms." << std::endl;
+            return 0;
+        }
         const auto graphicsProvider = providerFactory({});
-        generateFractalImageFile(graphicsProvider,
-                                 std::get<std::uint32_t>(flags.resolution),
-                                 e172::Math::fractal(flags.depth,
-                                                     flags.colorMask,
-                                                     complexFunction,
-                                                     concurent),
-                                 "D" + std::to_string(flags.depth) + "F" + flags.function,
-                                 flags.backgroundColor);
-        std::cout << "Finished.\nElapsed: " << timer.elapsed() << " ms." << std::endl;
+        const auto resolution = std::get<std::uint32_t>(flags.resolution);
+        // samples computed with distance estimation, the rest is mirrored or filled
+        std::atomic<std::size_t> sampled = 0;
+        const auto reportSampled = [&flags, &sampled, resolution] {
+            if (flags.distance) {
+                const auto pixels = std::size_t(resolution) * resolution;
+                std::cout << "Sampled: " << sampled << " of " << pixels << " pixels ("
+                          << double(sampled) * 100 / double(std::max<std::size_t>(pixels, 1))
+                          << "%)." << std::endl;
+            }
+        };
+        if (resolution < journaledResolution && !flags.resume) {
+            generateFractalImageFile(graphicsProvider,
+                                     resolution,
+                                     fractalFiller(flags.depth,
+                                                   flags.colorMask,
+                                                   complexFunction,
+                                                   complexFunctionEntry.symmetry,
+                                                   backend,
+                                                   julia,
+                                                   distance,
+                                                   &sampled),
+                                     "D" + std::to_string(flags.depth) + "F" + flags.function
+                                         + nameSuffix,
+                                     flags.backgroundColor);
+            reportSampled();
+            std::cout << "Finished.\nElapsed: " << timer.elapsed() << " ms." << std::endl;
+            return 0;
+        }
+
+        // long render: checkpoint finished tiles so that it can be resumed with --resume
+        const auto path = "./fractal" + std::to_string(resolution) + "D"
+                          + std::to_string(flags.depth) + "F" + flags.function + nameSuffix
+                          + ".png";
+        RenderJournal::Parameters parameters;
+        parameters.resolution = resolution;
+        parameters.depth = flags.depth;
+        parameters.colorMask = flags.colorMask;
+        parameters.julia = julia ? 1 : 0;
+        parameters.juliaParameter[0] = flags.julia.re;
+        parameters.juliaParameter[1] = flags.julia.im;
+        parameters.setFunctionName(flags.function);
+        RenderJournal journal(path + ".journal", parameters);
+        if (flags.resume) {
+            std::string error;
+            if (!journal.open(error)) {
+                std::cerr << "error: Can not resume: " << error << ".\n";
+                return 1;
+            }
+        } else {
+            if (std::filesystem::exists(journal.path())) {
+                std::cout << "Warning: overwriting unfinished render journal '" << journal.path()
+                          << "'. Use --resume to continue it." << std::endl;
+            }
+            if (!journal.start()) {
+                std::cerr << "error: Can not create '" << journal.path() << "'.\n";
+                return 1;
+            }
+        }
+        if (!generateFractalImageFile(graphicsProvider,
+                                      path,
+                                      resolution,
+                                      resolution,
+                                      journaledFractalFiller(flags.depth,
+                                                             flags.colorMask,
+                                                             complexFunction,
+                                                             complexFunctionEntry.symmetry,
+                                                             backend,
+                                                             journal,
+                                                             flags.resume,
+                                                             julia,
+                                                             distance,
+                                                             &sampled),
+                                      flags.backgroundColor)) {
+            std::cerr << "error: Can not write '" << path << "'. Journal kept.\n";
+            return 1;
+        }
+        const auto elapsed = std::max<std::int64_t>(timer.elapsed(), 1);
+        const auto overhead
+            = std::chrono::duration_cast<std::chrono::milliseconds>(journal.overhead()).count();
+        journal.finish();
+        reportSampled();
+        std::cout << "Finished.\nElapsed: " << elapsed << " ms (checkpointing: " << overhead
+                  << " ms summed over threads)." << std::endl;
         return 0;
     }
 
@@ -237,7 +486,7 @@ int main(int argc, const char **argv)
         if (flags.computeMode == FractalView::ComputeMode::GPU) {
             std::cout << "Warning: graphical compute mode not alloved in static mode. Used simple\n";
         }
-        bool concurent = flags.computeMode == FractalView::ComputeMode::CPUConcurent;
+        const auto backend = chooseBackend();
 
         app.setGraphicsProvider(graphicsProvider);
         app.setEventProvider(std::make_shared<e172::impl::sdl::EventProvider>());
@@ -248,28 +497,84 @@ int main(int argc, const char **argv)
                                           e172::Math::filler(flags.backgroundColor))
             + graphicsProvider->createImage(std::get<std::uint32_t>(flags.resolution),
                                             std::get<std::uint32_t>(flags.resolution),
-                                            e172::Math::fractal(flags.depth,
-                                                                flags.colorMask,
-                                                                complexFunction,
-                                                                concurent))));
+                                            fractalFiller(flags.depth,
+                                                          flags.colorMask,
+                                                          complexFunction,
+                                                          complexFunctionEntry.symmetry,
+                                                          backend,
+                                                          julia,
+                                                          distance))));
         return app.exec();
     }
 
     //default mode
     {
-        auto graphicsProvider = providerFactory("Fractal view (" + flags.function + ")");
+        std::shared_ptr<InputRecorder> inputRecorder;
+        std::shared_ptr<LatencyProbe> latencyProbe;
+        std::shared_ptr<e172::AbstractEventProvider> eventProvider;
+        std::shared_ptr<e172::AbstractGraphicsProvider> graphicsProvider;
+        if (!flags.replay.empty()) {
+            const auto events = ReplayEventProvider::load(flags.replay);
+            if (!events) {
+                std::cerr << "error: '" << flags.replay << "' is not an input record.\n";
+                return 1;
+            }
+            std::cout << "Replaying " << events->size() << " input events from " << flags.replay
+                      << std::endl;
+            latencyProbe = std::make_shared<LatencyProbe>();
+            eventProvider = std::make_shared<ReplayEventProvider>(*events, latencyProbe);
+            // headless: no window is needed
+            graphicsProvider = providerFactories.at(GraphicsProvider::Console)({});
+        } else {
+            if (!flags.record.empty()) {
+                inputRecorder = std::make_shared<InputRecorder>(flags.record);
+                if (!inputRecorder->isOpen()) {
+                    std::cerr << "error: Can not write '" << flags.record << "'.\n";
+                    return 1;
+                }
+                latencyProbe = std::make_shared<LatencyProbe>();
+            }
+            eventProvider = std::make_shared<e172::impl::sdl::EventProvider>();
+            graphicsProvider = providerFactory("Fractal view (" + flags.function + ")");
+        }
 
         app.setGraphicsProvider(graphicsProvider);
-        app.setEventProvider(std::make_shared<e172::impl::sdl::EventProvider>());
-        app.setRenderInterval(1000 / 30);
+        app.setEventProvider(eventProvider);
+        app.setRenderInterval(1000 / std::max<std::size_t>(flags.fps, 1));
+
+        if (flags.orbitDensity != OrbitDensity::Mode::None) {
+            const auto resolution = std::get<std::uint32_t>(flags.resolution);
+            app.addEntity(e172::FactoryMeta::make<OrbitDensityView>(
+                complexFunction,
+                OrbitDensity::Settings{.width = resolution,
+                                       .height = resolution,
+                                       .depth = flags.depth,
+                                       .mode = flags.orbitDensity},
+                flags.samples,
+                flags.colorMask,
+                flags.backgroundColor));
+            return app.exec();
+        }
 
         app.addEntity(e172::FactoryMeta::make<FractalView>(std::get<std::uint32_t>(flags.resolution),
                                                            flags.depth,
                                                            flags.colorMask,
                                                            flags.backgroundColor,
                                                            complexFunction,
-                                                           flags.computeMode));
+                                                           complexFunctionEntry.symmetry,
+                                                           julia,
+                                                           distance,
+                                                           flags.computeMode,
+                                                           flags.fps,
+                                                           autoTuner,
+                                                           inputRecorder,
+                                                           latencyProbe));
 
-        return app.exec();
+        const auto code = app.exec();
+        if (latencyProbe) {
+            // console frames of a headless replay go to stdout
+            latencyProbe->report(flags.replay.empty() ? std::cout : std::cerr);
+        }
+        return code;
     }
 }
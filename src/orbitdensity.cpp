@@ -0,0 +1,264 @@
+#include "orbitdensity.h"
+
+#include "renderengine.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+#include <thread>
+
+namespace {
+
+/// coarse escape-time map resolution used for importance sampling
+constexpr std::size_t importanceGridSize = 256;
+
+/// weight every cell gets so that no region has zero probability
+constexpr double importanceFloor = 0.02;
+
+/// share of the brightest pixels clipped by tone mapping
+constexpr double toneMappingClip = 0.001;
+
+} // namespace
+
+std::string OrbitDensity::toString(Mode mode)
+{
+    if (mode == Mode::Buddhabrot) {
+        return "buddhabrot";
+    } else if (mode == Mode::Nebulabrot) {
+        return "nebulabrot";
+    } else {
+        return "none";
+    }
+}
+
+OrbitDensity::OrbitDensity(const e172::ComplexFunction<double> &function,
+                           const Settings &settings)
+    : m_function(function)
+    , m_settings(settings)
+{
+    if (m_settings.threadCount == 0) {
+        m_settings.threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const auto histogramSize = channelCount() * m_settings.width * m_settings.height;
+    m_shards.assign(m_settings.threadCount, std::vector<float>(histogramSize));
+    m_total.assign(histogramSize, 0);
+    buildImportanceMap();
+}
+
+std::size_t OrbitDensity::channelCount() const
+{
+    return m_settings.mode == Mode::Nebulabrot ? 3 : 1;
+}
+
+std::size_t OrbitDensity::channelDepth(std::size_t channel) const
+{
+    return std::max<std::size_t>(m_settings.depth >> (channel * 2), 1);
+}
+
+void OrbitDensity::buildImportanceMap()
+{
+    constexpr auto g = importanceGridSize;
+    const auto depth = m_settings.depth;
+    const auto cellSize = 4. / double(g);
+
+    std::vector<std::size_t> corners((g + 1) * (g + 1));
+    std::vector<std::size_t> rows(g + 1);
+    std::iota(rows.begin(), rows.end(), 0);
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(), [&](std::size_t y) {
+        for (std::size_t x = 0; x <= g; ++x) {
+            corners[y * (g + 1) + x] = e172::Math::fractalLevel(
+                e172::Complex<double>(double(x) * cellSize - 2, double(y) * cellSize - 2),
+                depth,
+                m_function);
+        }
+    });
+
+    m_cellWeight.resize(g * g);
+    m_cellCdf.resize(g * g);
+    m_totalWeight = 0;
+    for (std::size_t y = 0; y < g; ++y) {
+        for (std::size_t x = 0; x < g; ++x) {
+            const std::size_t levels[] = {corners[y * (g + 1) + x],
+                                          corners[y * (g + 1) + x + 1],
+                                          corners[(y + 1) * (g + 1) + x],
+                                          corners[(y + 1) * (g + 1) + x + 1]};
+            std::size_t inside = 0;
+            std::size_t maxEscape = 0;
+            for (const auto level : levels) {
+                if (level >= depth) {
+                    ++inside;
+                } else {
+                    maxEscape = std::max(maxEscape, level);
+                }
+            }
+            // long escaping orbits live near the boundary
+            double weight = importanceFloor;
+            if (inside > 0 && inside < 4) {
+                weight += 1;
+            } else if (inside == 0) {
+                weight += double(maxEscape) / double(depth);
+            }
+            m_cellWeight[y * g + x] = weight;
+            m_totalWeight += weight;
+            m_cellCdf[y * g + x] = m_totalWeight;
+        }
+    }
+}
+
+void OrbitDensity::sampleBatch(std::size_t shard, std::mt19937_64 &random)
+{
+    TraceScope scope("orbit_batch", std::int64_t(shard));
+    constexpr auto g = importanceGridSize;
+    const auto cellSize = 4. / double(g);
+    const auto w = m_settings.width;
+    const auto h = m_settings.height;
+    const auto channels = channelCount();
+    const auto maxDepth = channelDepth(0);
+
+    auto &histogram = m_shards[shard];
+    std::vector<e172::Complex<double>> orbit(maxDepth);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    for (std::size_t i = 0; i < m_settings.batchSize; ++i) {
+        const auto cell = std::min<std::size_t>(
+            std::upper_bound(m_cellCdf.begin(), m_cellCdf.end(), uniform(random) * m_totalWeight)
+                - m_cellCdf.begin(),
+            g * g - 1);
+        const e172::Complex<double> c(double(cell % g + uniform(random)) * cellSize - 2,
+                                      double(cell / g + uniform(random)) * cellSize - 2);
+        // uniform density over importance density
+        const auto weight = float(m_totalWeight / (double(g * g) * m_cellWeight[cell]));
+
+        e172::Complex<double> z = 0;
+        std::size_t n = 0;
+        bool escaped = false;
+        for (; n < maxDepth; ++n) {
+            z = m_function(z) + c;
+            if (std::norm(z) > 4) {
+                escaped = true;
+                break;
+            }
+            orbit[n] = z;
+        }
+        if (!escaped) {
+            continue;
+        }
+
+        for (std::size_t channel = 0; channel < channels; ++channel) {
+            if (n >= channelDepth(channel)) {
+                continue;
+            }
+            auto *channelHistogram = histogram.data() + channel * w * h;
+            for (std::size_t k = 0; k < n; ++k) {
+                const auto x = (orbit[k].real() + 2) / 4 * double(w);
+                const auto y = (orbit[k].imag() + 2) / 4 * double(h);
+                if (x >= 0 && y >= 0 && x < double(w) && y < double(h)) {
+                    channelHistogram[std::size_t(y) * w + std::size_t(x)] += weight;
+                }
+            }
+        }
+    }
+}
+
+void OrbitDensity::round()
+{
+    std::lock_guard shardLock(m_shardMutex);
+    // one batch per shard, the calling thread and pool helpers take batches until none is left
+    runRows({.kind = RenderBackend::Kind::Threads, .threads = m_settings.threadCount},
+            m_settings.threadCount,
+            [this](std::size_t t) {
+                std::mt19937_64 random(m_settings.seed
+                                       ^ ((m_round * m_settings.threadCount + t + 1)
+                                          * 0x9e3779b97f4a7c15ull));
+                sampleBatch(t, random);
+            });
+    ++m_round;
+    if (m_snapshotRequested.exchange(false)) {
+        mergeShards();
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_samples += m_settings.threadCount * m_settings.batchSize;
+}
+
+void OrbitDensity::mergeShards()
+{
+    std::lock_guard lock(m_mutex);
+    TraceScope scope("merge", std::int64_t(m_round));
+    const auto rowSize = m_settings.width;
+    std::vector<std::size_t> rows(m_total.size() / rowSize);
+    std::iota(rows.begin(), rows.end(), 0);
+    std::for_each(std::execution::par_unseq, rows.begin(), rows.end(), [this, rowSize](auto row) {
+        auto *total = m_total.data() + row * rowSize;
+        for (auto &shard : m_shards) {
+            auto *part = shard.data() + row * rowSize;
+            for (std::size_t i = 0; i < rowSize; ++i) {
+                total[i] += part[i];
+                part[i] = 0;
+            }
+        }
+    });
+}
+
+std::size_t OrbitDensity::samples() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_samples;
+}
+
+void OrbitDensity::image(std::size_t w,
+                         std::size_t h,
+                         e172::Color *bitmap,
+                         e172::Color colorMask,
+                         e172::Color backgroundColor)
+{
+    m_snapshotRequested = true;
+    if (std::unique_lock shardLock(m_shardMutex, std::try_to_lock); shardLock) {
+        m_snapshotRequested = false;
+        mergeShards();
+    }
+
+    std::lock_guard lock(m_mutex);
+    TraceScope scope("color");
+    const auto size = m_settings.width * m_settings.height;
+    const auto channels = channelCount();
+
+    std::vector<double> reference(channels, 0);
+    std::vector<double> values;
+    for (std::size_t channel = 0; channel < channels; ++channel) {
+        const auto begin = m_total.begin() + channel * size;
+        values.clear();
+        std::copy_if(begin, begin + size, std::back_inserter(values), [](auto v) {
+            return v > 0;
+        });
+        if (!values.empty()) {
+            const auto n = std::size_t(double(values.size() - 1) * (1 - toneMappingClip));
+            std::nth_element(values.begin(), values.begin() + n, values.end());
+            reference[channel] = values[n];
+        }
+    }
+
+    const auto tone = [&](std::size_t channel, std::size_t i) {
+        if (reference[channel] <= 0) {
+            return 0.;
+        }
+        return std::min(1., std::sqrt(m_total[channel * size + i] / reference[channel]));
+    };
+
+    for (std::size_t y = 0; y < std::min(h, m_settings.height); ++y) {
+        for (std::size_t x = 0; x < std::min(w, m_settings.width); ++x) {
+            const auto i = y * m_settings.width + x;
+            if (m_settings.mode == Mode::Nebulabrot) {
+                const auto r = e172::Color(tone(0, i) * 0xff);
+                const auto g = e172::Color(tone(1, i) * 0xff);
+                const auto b = e172::Color(tone(2, i) * 0xff);
+                bitmap[y * w + x] = 0xff000000 | (r << 16) | (g << 8) | b;
+            } else {
+                bitmap[y * w + x] = e172::blend(e172::Color(colorMask * tone(0, i)),
+                                                backgroundColor);
+            }
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <e172/utility/flagparser.h>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The OrbitDensity class accumulates orbit density images (Buddhabrot, Nebulabrot)
+ * of z -> f(z) + c over the [-2, 2] x [-2, 2] plane.
+ * Random c are drawn with importance sampling from a coarse escape-time map (cells near the
+ * boundary are favoured), escaping orbits are re-run and their points counted. Every batch
+ * owns a histogram shard, so workers never share memory. Shards are merged only when a snapshot
+ * is taken (image), not after every round.
+ */
+class OrbitDensity
+{
+public:
+    enum class Mode { None, Buddhabrot, Nebulabrot };
+
+    static std::string toString(Mode mode);
+
+    struct Settings
+    {
+        std::size_t width = 1024;
+        std::size_t height = 1024;
+        std::size_t depth = 1024;
+        Mode mode = Mode::Buddhabrot;
+        std::size_t threadCount = 0;
+        /// orbits per thread per round
+        std::size_t batchSize = 1 << 15;
+        std::uint64_t seed = 0x5eed;
+    };
+
+    OrbitDensity(const e172::ComplexFunction<double> &function, const Settings &settings);
+
+    const Settings &settings() const { return m_settings; }
+
+    /**
+     * @brief round - samples threadCount * batchSize orbits on the render worker pool. Merges
+     * the shards when image was called meanwhile
+     */
+    void round();
+
+    std::size_t samples() const;
+
+    /**
+     * @brief image - tone mapped density. Buddhabrot is colored with colorMask,
+     * Nebulabrot maps depth, depth / 4 and depth / 16 orbits to red, green and blue.
+     * Merges the shards first unless a round is running, which then merges them when it ends,
+     * so the image may lag one round behind
+     */
+    void image(std::size_t w,
+               std::size_t h,
+               e172::Color *bitmap,
+               e172::Color colorMask,
+               e172::Color backgroundColor);
+
+private:
+    std::size_t channelCount() const;
+    std::size_t channelDepth(std::size_t channel) const;
+    void buildImportanceMap();
+    void sampleBatch(std::size_t shard, std::mt19937_64 &random);
+    /// needs m_shardMutex
+    void mergeShards();
+
+private:
+    e172::ComplexFunction<double> m_function;
+    Settings m_settings;
+
+    /// cumulative weights of coarse cells
+    std::vector<double> m_cellCdf;
+    std::vector<double> m_cellWeight;
+    double m_totalWeight = 0;
+
+    /// held by a running round and by a merge
+    std::mutex m_shardMutex;
+    std::vector<std::vector<float>> m_shards;
+    std::uint64_t m_round = 0;
+    std::atomic<bool> m_snapshotRequested = false;
+
+    mutable std::mutex m_mutex;
+    std::vector<double> m_total;
+    std::size_t m_samples = 0;
+};
+
+inline e172::Either<e172::FlagParseError, OrbitDensity::Mode> operator>>(
+    e172::RawFlagValue raw, e172::TypeTag<OrbitDensity::Mode>)
+{
+    if (raw.str == "none") {
+        return e172::Right(OrbitDensity::Mode::None);
+    } else if (raw.str == "buddhabrot") {
+        return e172::Right(OrbitDensity::Mode::Buddhabrot);
+    } else if (raw.str == "nebulabrot") {
+        return e172::Right(OrbitDensity::Mode::Nebulabrot);
+    } else {
+        return e172::Left(e172::FlagParseError::EnumValueNotFound);
+    }
+}
@@ -0,0 +1,53 @@
+#include "orbitdensityview.h"
+
+OrbitDensityView::OrbitDensityView(e172::FactoryMeta &&meta,
+                                   const e172::ComplexFunction<double> &function,
+                                   const OrbitDensity::Settings &settings,
+                                   std::size_t targetSamples,
+                                   e172::Color colorMask,
+                                   e172::Color backgroundColor)
+    : e172::Entity(std::forward<e172::FactoryMeta>(meta))
+    , m_density(function, settings)
+    , m_targetSamples(targetSamples)
+    , m_colorMask(colorMask)
+    , m_backgroundColor(backgroundColor)
+    , m_worker([this] {
+        while (!m_stopping && m_density.samples() < m_targetSamples) {
+            m_density.round();
+            ++m_rounds;
+        }
+    })
+{}
+
+OrbitDensityView::~OrbitDensityView()
+{
+    m_stopping = true;
+    m_worker.join();
+}
+
+void OrbitDensityView::render(e172::Context *, e172::AbstractRenderer *renderer)
+{
+    const std::size_t rounds = m_rounds;
+    if (rounds == m_displayedRounds) {
+        return;
+    }
+    m_displayedRounds = rounds;
+
+    renderer->setAutoClear(false);
+    renderer->modifyBitmap([this, renderer](e172::Color *bitmap) {
+        m_density.image(renderer->resolution().size_tX(),
+                        renderer->resolution().size_tY(),
+                        bitmap,
+                        m_colorMask,
+                        m_backgroundColor);
+    });
+
+    const auto samples = m_density.samples();
+    const auto info = OrbitDensity::toString(m_density.settings().mode) + " "
+                      + std::to_string(samples / 1000) + "k / "
+                      + std::to_string(m_targetSamples / 1000) + "k samples";
+    renderer->drawString(info,
+                         {8, 8.},
+                         0xffffff,
+                         e172::TextFormat::fromFontSize(m_density.settings().width / info.size()));
+}
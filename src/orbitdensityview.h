@@ -0,0 +1,40 @@
+#pragma once
+
+#include "orbitdensity.h"
+
+#include <atomic>
+#include <e172/entity.h>
+#include <e172/graphics/abstractrenderer.h>
+#include <memory>
+#include <thread>
+
+/**
+ * @brief The OrbitDensityView class shows an orbit density image while it accumulates.
+ * Sampling rounds run on a background thread, every finished round is displayed.
+ */
+class OrbitDensityView : public e172::Entity
+{
+public:
+    OrbitDensityView(e172::FactoryMeta &&meta,
+                     const e172::ComplexFunction<double> &function,
+                     const OrbitDensity::Settings &settings,
+                     std::size_t targetSamples,
+                     e172::Color colorMask,
+                     e172::Color backgroundColor);
+    ~OrbitDensityView();
+
+    // Entity interface
+public:
+    void proceed(e172::Context *, e172::EventHandler *) override {}
+    void render(e172::Context *, e172::AbstractRenderer *renderer) override;
+
+private:
+    OrbitDensity m_density;
+    std::size_t m_targetSamples;
+    e172::Color m_colorMask, m_backgroundColor;
+
+    std::atomic<std::size_t> m_rounds = 0;
+    std::size_t m_displayedRounds = 0;
+    std::atomic<bool> m_stopping = false;
+    std::thread m_worker;
+};
@@ -0,0 +1,70 @@
+#include "pngencoder.h"
+
+#include <cstdint>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+void appendU32(std::string &out, std::uint32_t value)
+{
+    out.push_back(char(value >> 24));
+    out.push_back(char(value >> 16));
+    out.push_back(char(value >> 8));
+    out.push_back(char(value));
+}
+
+void appendChunk(std::string &out, const char type[4], const std::string &data)
+{
+    appendU32(out, std::uint32_t(data.size()));
+    const auto begin = out.size();
+    out.append(type, 4);
+    out += data;
+    const auto crc = ::crc32(0,
+                             reinterpret_cast<const Bytef *>(out.data() + begin),
+                             uInt(out.size() - begin));
+    appendU32(out, std::uint32_t(crc));
+}
+
+} // namespace
+
+std::string encodePng(const e172::Color *pixels, std::size_t w, std::size_t h)
+{
+    // every row starts with filter type 0 (none)
+    std::vector<Bytef> raw;
+    raw.reserve((w * 4 + 1) * h);
+    for (std::size_t y = 0; y < h; ++y) {
+        raw.push_back(0);
+        for (std::size_t x = 0; x < w; ++x) {
+            const auto color = pixels[y * w + x];
+            raw.push_back(Bytef(color >> 16));
+            raw.push_back(Bytef(color >> 8));
+            raw.push_back(Bytef(color));
+            raw.push_back(Bytef(color >> 24));
+        }
+    }
+
+    auto size = ::compressBound(uLong(raw.size()));
+    std::string compressed(size, '\0');
+    if (::compress2(reinterpret_cast<Bytef *>(compressed.data()),
+                    &size,
+                    raw.data(),
+                    uLong(raw.size()),
+                    Z_BEST_SPEED)
+        != Z_OK) {
+        return {};
+    }
+    compressed.resize(size);
+
+    std::string header;
+    appendU32(header, std::uint32_t(w));
+    appendU32(header, std::uint32_t(h));
+    // bit depth 8, color type 6 (RGBA), deflate, adaptive filtering, no interlace
+    header += std::string{8, 6, 0, 0, 0};
+
+    std::string png = "\x89PNG\r\n\x1a\n";
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", compressed);
+    appendChunk(png, "IEND", {});
+    return png;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <e172/graphics/color.h>
+#include <string>
+
+/**
+ * @brief encodePng - encodes w x h ARGB pixels as an 8-bit RGBA PNG in memory.
+ * Needs no graphics provider, so it can be used headless and from any thread
+ * @return empty string on failure
+ */
+std::string encodePng(const e172::Color *pixels, std::size_t w, std::size_t h);
@@ -0,0 +1,112 @@
+#include "prefetcher.h"
+
+#include "trace.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+Prefetcher::Prefetcher(std::size_t capacity, std::size_t frameSize, const Renderer &renderer)
+    : m_capacity(std::max<std::size_t>(capacity, 1))
+    , m_frameSize(frameSize)
+    , m_renderer(renderer)
+    , m_worker([this] { workerLoop(); })
+{}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+        m_pending.clear();
+    }
+    m_preempted = true;
+    m_condition.notify_all();
+    m_worker.join();
+}
+
+void Prefetcher::schedule(const std::vector<Viewport> &viewports)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_pending.clear();
+        for (const auto &viewport : viewports) {
+            const auto ready = std::find_if(m_ready.begin(), m_ready.end(), [&viewport](auto &r) {
+                return r.first == viewport;
+            });
+            if (ready == m_ready.end()) {
+                m_pending.push_back(viewport);
+            }
+        }
+        m_preempted = false;
+    }
+    m_condition.notify_one();
+}
+
+void Prefetcher::preempt()
+{
+    std::lock_guard lock(m_mutex);
+    m_pending.clear();
+    m_preempted = true;
+}
+
+Prefetcher::Frame Prefetcher::take(const Viewport &viewport)
+{
+    std::lock_guard lock(m_mutex);
+    const auto it = std::find_if(m_ready.begin(), m_ready.end(), [&viewport](auto &r) {
+        return r.first == viewport;
+    });
+    if (it == m_ready.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+    return it->second;
+}
+
+double Prefetcher::hitRate() const
+{
+    const auto total = m_hits + m_misses;
+    return total > 0 ? double(m_hits) / double(total) : 0;
+}
+
+void Prefetcher::workerLoop()
+{
+#ifdef __linux__
+    // nice applies per thread on linux
+    ::setpriority(PRIO_PROCESS, ::syscall(SYS_gettid), 19);
+#endif
+    if (Tracer::enabled()) {
+        Tracer::setThreadName("prefetcher");
+    }
+    for (;;) {
+        Viewport viewport;
+        {
+            std::unique_lock lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            viewport = m_pending.front();
+            m_pending.pop_front();
+        }
+
+        auto frame = std::make_shared<std::vector<e172::Color>>(m_frameSize);
+        if (!m_renderer(viewport, frame->data(), m_preempted)) {
+            continue;
+        }
+
+        std::lock_guard lock(m_mutex);
+        if (m_preempted) {
+            continue;
+        }
+        m_ready.emplace_back(viewport, std::move(frame));
+        while (m_ready.size() > m_capacity) {
+            m_ready.pop_front();
+        }
+    }
+}
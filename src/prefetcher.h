@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The Prefetcher class computes full quality frames of viewports the user is likely to
+ * open next on one low priority thread while the view is idle. Results are kept in a bounded
+ * buffer. Work is preempted as soon as real input arrives.
+ */
+class Prefetcher
+{
+public:
+    struct Viewport
+    {
+        e172::Vector<double> offset;
+        double zoom = 0;
+
+        bool operator==(const Viewport &other) const
+        {
+            return offset.x() == other.offset.x() && offset.y() == other.offset.y()
+                   && zoom == other.zoom;
+        }
+    };
+
+    using Frame = std::shared_ptr<const std::vector<e172::Color>>;
+
+    /**
+     * @brief Renderer - fills frame of viewport. Must return false as soon as possible when
+     * preempted becomes true
+     */
+    using Renderer = std::function<
+        bool(const Viewport &viewport, e172::Color *frame, const std::atomic<bool> &preempted)>;
+
+    Prefetcher(std::size_t capacity, std::size_t frameSize, const Renderer &renderer);
+    Prefetcher(const Prefetcher &) = delete;
+    ~Prefetcher();
+
+    /**
+     * @brief schedule - replaces pending work with viewports (in priority order).
+     * Viewports already in the buffer are skipped
+     */
+    void schedule(const std::vector<Viewport> &viewports);
+
+    /**
+     * @brief preempt - drops pending work and aborts the frame in progress
+     */
+    void preempt();
+
+    /**
+     * @brief take - ready frame of viewport or nullptr. Counts a hit or a miss
+     */
+    Frame take(const Viewport &viewport);
+
+    std::size_t hits() const { return m_hits; }
+    std::size_t misses() const { return m_misses; }
+    double hitRate() const;
+
+private:
+    void workerLoop();
+
+private:
+    std::size_t m_capacity;
+    std::size_t m_frameSize;
+    Renderer m_renderer;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Viewport> m_pending;
+    std::deque<std::pair<Viewport, Frame>> m_ready;
+    bool m_stopping = false;
+    std::atomic<bool> m_preempted = false;
+
+    std::atomic<std::size_t> m_hits = 0;
+    std::atomic<std::size_t> m_misses = 0;
+
+    std::thread m_worker;
+};
@@ -0,0 +1,545 @@
+#include "renderengine.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <execution>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// cell rows of one distance estimation job, exterior disks are filled within it
+constexpr std::size_t distanceBandCells = 16;
+
+/// true distance to the set lies in [distance * lower, distance * upper] (see EscapeEstimate)
+constexpr double distanceLowerBound = 0.25;
+constexpr double distanceUpperBound = 2;
+
+e172::Complex<double> samplePoint(const RenderViewport &viewport,
+                                  std::size_t w,
+                                  std::size_t h,
+                                  std::size_t x,
+                                  std::size_t y)
+{
+    const auto value = e172::Vector(double(x) / double(w) * 2 - 1, double(y) / double(h) * 2 - 1)
+                           / viewport.zoom
+                       + viewport.offset;
+    return value.toComplex();
+}
+
+e172::Color finishColor(const RenderOptions &options, e172::Color color)
+{
+    return options.backgroundColor ? e172::blend(color, *options.backgroundColor) : color;
+}
+
+/**
+ * @brief estimateColor - full mask inside the set, fading to 0 over distanceShadePixels
+ * @param pixelSize - distance between samples of the frame in the plane
+ */
+e172::Color estimateColor(const EscapeEstimate &estimate,
+                          std::size_t depth,
+                          e172::Color colorMask,
+                          double pixelSize)
+{
+    if (estimate.level >= depth) {
+        return colorMask;
+    }
+    const auto shade = std::min(estimate.distance / (distanceShadePixels * pixelSize), 1.);
+    return e172::Color(colorMask * (1 - shade));
+}
+
+/**
+ * @brief estimateSample - color of pixel (x, y) of a w x h frame in distance estimation mode
+ * @param exteriorRadius - samples closer than it are proven to get the exterior color
+ */
+e172::Color estimateSample(const RenderViewport &viewport,
+                           const e172::ComplexFunction<double> &function,
+                           std::size_t depth,
+                           const RenderOptions &options,
+                           std::size_t w,
+                           std::size_t h,
+                           std::size_t x,
+                           std::size_t y,
+                           double &exteriorRadius)
+{
+    const auto estimate = escapeEstimate(samplePoint(viewport, w, h, x, y),
+                                         depth,
+                                         function,
+                                         options.distance.derivative,
+                                         options.julia);
+    const auto pixelSize = 2 / (viewport.zoom * double(w));
+    // the estimate of a sample this much closer is still beyond the shading width
+    exteriorRadius = estimate.level >= depth
+                         ? 0.
+                         : estimate.distance * distanceLowerBound
+                               - distanceUpperBound * distanceShadePixels * pixelSize;
+    return finishColor(options, estimateColor(estimate, depth, options.colorMask, pixelSize));
+}
+
+/**
+ * @brief The Pass struct - state of one render call. Row jobs capture it by a single reference,
+ * so wrapping them into std::function does not allocate
+ */
+struct Pass
+{
+    const RenderViewport &viewport;
+    const e172::ComplexFunction<double> &function;
+    std::size_t depth;
+    const RenderOptions &options;
+    const RenderTarget &target;
+    const SymmetryPlan &plan;
+    std::size_t x;
+    std::size_t y;
+    std::size_t w;
+    std::size_t h;
+    std::size_t stride;
+    std::size_t deterioration;
+    /// frame columns [x, columnEnd) are computed, the rest is mirrored
+    std::size_t columnEnd;
+    /// distance between samples in the plane
+    double pixelWidth;
+    double pixelHeight;
+
+    bool cancelled() const
+    {
+        return options.cancelled && options.cancelled->load(std::memory_order_relaxed);
+    }
+
+    void countSamples(std::size_t count) const
+    {
+        if (options.sampled) {
+            options.sampled->fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    e172::Color sample(std::size_t sx, std::size_t sy) const
+    {
+        return renderSample(viewport,
+                            function,
+                            depth,
+                            options,
+                            target.width,
+                            target.height,
+                            sx,
+                            sy);
+    }
+
+    e172::Color estimate(std::size_t sx, std::size_t sy, double &exteriorRadius) const
+    {
+        return estimateSample(viewport,
+                              function,
+                              depth,
+                              options,
+                              target.width,
+                              target.height,
+                              sx,
+                              sy,
+                              exteriorRadius);
+    }
+
+    e172::Color exteriorColor() const { return finishColor(options, e172::Color(0)); }
+
+    e172::Color *line(std::size_t fy) const { return target.pixels.data() + (fy - y) * stride; }
+
+    /**
+     * @brief fillCell - fills pixels of block (cx, cy) of the region
+     */
+    void fillCell(std::size_t cx, std::size_t cy, e172::Color color) const
+    {
+        const auto left = std::max(cx * deterioration, x);
+        const auto right = std::min(cx * deterioration + deterioration, columnEnd);
+        for (auto fy = std::max(cy * deterioration, y);
+             fy < std::min(cy * deterioration + deterioration, y + h);
+             ++fy) {
+            std::fill(line(fy) + (left - x), line(fy) + (right - x), color);
+        }
+    }
+
+    /**
+     * @brief band - computes frame rows [band * deterioration, band * deterioration +
+     * deterioration) clipped to region. First row is computed, the others are its copies
+     */
+    void band(std::size_t band) const
+    {
+        const auto top = band * deterioration;
+        const auto begin = std::max(top, y);
+        const auto end = std::min(top + deterioration, y + h);
+        if (begin >= end || cancelled() || plan.rowMirrored(begin)) {
+            return;
+        }
+        TraceScope scope("row", std::int64_t(begin));
+        auto *first = line(begin);
+        std::size_t count = 0;
+        for (auto fx = x; fx < columnEnd;) {
+            const auto left = fx - fx % deterioration;
+            const auto right = std::min(left + deterioration, columnEnd);
+            std::fill(first + (fx - x), first + (right - x), sample(left, top));
+            fx = right;
+            ++count;
+        }
+        for (auto fy = begin + 1; fy < end; ++fy) {
+            std::copy(first, first + (columnEnd - x), line(fy));
+        }
+        countSamples(count);
+    }
+
+    /**
+     * @brief distanceBand - computes block rows [band * distanceBandCells, band *
+     * distanceBandCells + distanceBandCells) of the region in distance estimation mode.
+     * Blocks are scanned row by row, an exterior sample fills the blocks of its exterior disk
+     * below and to the right of it (within the band) which are then skipped
+     */
+    void distanceBand(std::size_t band) const
+    {
+        const auto firstRow = y / deterioration + band * distanceBandCells;
+        const auto endRow = std::min(firstRow + distanceBandCells, (y + h - 1) / deterioration + 1);
+        const auto firstColumn = x / deterioration;
+        const auto endColumn = (columnEnd - 1) / deterioration + 1;
+        const auto columns = endColumn - firstColumn;
+
+        // reused by every call on this thread
+        thread_local std::vector<unsigned char> covered;
+        const auto cells = (endRow - firstRow) * columns;
+        if (covered.size() < cells) {
+            covered.resize(cells);
+        }
+        std::fill_n(covered.begin(), cells, 0);
+        const auto cellWidth = double(deterioration) * pixelWidth;
+        const auto cellHeight = double(deterioration) * pixelHeight;
+
+        std::size_t count = 0;
+        for (auto cy = firstRow; cy < endRow; ++cy) {
+            if (cancelled()) {
+                break;
+            }
+            if (plan.rowMirrored(cy * deterioration)) {
+                continue;
+            }
+            TraceScope scope("row", std::int64_t(std::max(cy * deterioration, y)));
+            for (auto cx = firstColumn; cx < endColumn; ++cx) {
+                if (covered[(cy - firstRow) * columns + cx - firstColumn]) {
+                    continue;
+                }
+                double radius;
+                fillCell(cx, cy, estimate(cx * deterioration, cy * deterioration, radius));
+                ++count;
+                if (radius <= 0) {
+                    continue;
+                }
+                const auto exterior = exteriorColor();
+                const auto rx = radius / cellWidth;
+                const auto ry = radius / cellHeight;
+                for (std::size_t dy = 0; cy + dy < endRow && double(dy) <= ry; ++dy) {
+                    const auto t = double(dy) / ry;
+                    const auto half = std::size_t(rx * std::sqrt(1 - t * t));
+                    const auto from = dy == 0 ? cx + 1
+                                              : std::max(cx - std::min(cx, half), firstColumn);
+                    const auto to = std::min(cx + half + 1, endColumn);
+                    for (auto fx = from; fx < to; ++fx) {
+                        auto &mark = covered[(cy + dy - firstRow) * columns + fx - firstColumn];
+                        if (!mark) {
+                            mark = 1;
+                            fillCell(fx, cy + dy, exterior);
+                        }
+                    }
+                }
+            }
+        }
+        countSamples(count);
+    }
+};
+
+std::string kindToString(RenderBackend::Kind kind)
+{
+    if (kind == RenderBackend::Kind::ParallelStl) {
+        return "par";
+    } else if (kind == RenderBackend::Kind::Threads) {
+        return "threads";
+    } else {
+        return "serial";
+    }
+}
+
+/**
+ * @brief The WorkerPool class - process wide helper threads of the Threads backend. The pool
+ * grows to the largest helper count requested and is reused by every later call, so a call
+ * allocates nothing once the pool is large enough. Calls from several threads share the helpers
+ */
+class WorkerPool
+{
+public:
+    static WorkerPool &instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        for (auto &thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief run - runs task on the calling thread and on up to helpers pool threads, returns
+     * when every started copy has returned. Helpers that did not start before the calling thread
+     * finished are not started anymore, so task must split its work dynamically
+     */
+    void run(std::size_t helpers, const std::function<void()> &task)
+    {
+        Job job{.task = &task, .tickets = helpers};
+        {
+            std::lock_guard lock(m_mutex);
+            while (m_threads.size() < helpers) {
+                m_threads.emplace_back([this] { workerLoop(); });
+            }
+            job.next = m_jobs;
+            m_jobs = &job;
+        }
+        m_condition.notify_all();
+
+        task();
+
+        std::unique_lock lock(m_mutex);
+        job.tickets = 0;
+        m_doneCondition.wait(lock, [&job] { return job.running == 0; });
+        for (auto **link = &m_jobs; *link; link = &(*link)->next) {
+            if (*link == &job) {
+                *link = job.next;
+                break;
+            }
+        }
+    }
+
+private:
+    /// lives on the stack of the calling thread for the duration of run
+    struct Job
+    {
+        const std::function<void()> *task;
+        std::size_t tickets;
+        std::size_t running = 0;
+        Job *next = nullptr;
+    };
+
+    WorkerPool() = default;
+
+    Job *takeJob()
+    {
+        for (auto *job = m_jobs; job; job = job->next) {
+            if (job->tickets > 0) {
+                --job->tickets;
+                ++job->running;
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void workerLoop()
+    {
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            Job *job = nullptr;
+            m_condition.wait(lock, [this, &job] { return m_stopping || (job = takeJob()); });
+            if (!job) {
+                return;
+            }
+            lock.unlock();
+            (*job->task)();
+            lock.lock();
+            if (--job->running == 0 && job->tickets == 0) {
+                m_doneCondition.notify_all();
+            }
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_doneCondition;
+    Job *m_jobs = nullptr;
+    std::vector<std::thread> m_threads;
+    bool m_stopping = false;
+};
+
+} // namespace
+
+std::string RenderBackend::toString() const
+{
+    if (kind == Kind::Threads) {
+        return kindToString(kind) + " x" + std::to_string(threads) + " /"
+               + std::to_string(bandRows);
+    }
+    return kindToString(kind);
+}
+
+std::string RenderBackend::kindName(Kind kind)
+{
+    return kindToString(kind);
+}
+
+void runRows(const RenderBackend &backend,
+             std::size_t rows,
+             const std::function<void(std::size_t)> &execLine)
+{
+    if (backend.kind == RenderBackend::Kind::ParallelStl) {
+        // row indices are only read, every thread keeps its own so concurrent calls are fine.
+        // Not par_unseq: rows may take locks (first trace event of a thread)
+        thread_local std::vector<std::size_t> job;
+        if (job.size() < rows) {
+            job.resize(rows);
+            std::iota(job.begin(), job.end(), 0);
+        }
+        std::for_each(std::execution::par, job.begin(), job.begin() + rows, execLine);
+    } else if (backend.kind == RenderBackend::Kind::Threads && backend.threads > 1) {
+        struct
+        {
+            const std::function<void(std::size_t)> &execLine;
+            std::size_t rows;
+            std::size_t bandRows;
+            std::atomic<std::size_t> next = 0;
+        } bands{execLine, rows, std::max<std::size_t>(backend.bandRows, 1)};
+        // captured by a single reference so that std::function keeps it inline
+        const std::function<void()> worker = [&bands] {
+            for (auto begin = bands.next.fetch_add(bands.bandRows); begin < bands.rows;
+                 begin = bands.next.fetch_add(bands.bandRows)) {
+                for (auto y = begin; y < std::min(begin + bands.bandRows, bands.rows); ++y) {
+                    bands.execLine(y);
+                }
+            }
+        };
+        // calling thread is one of the workers
+        WorkerPool::instance().run(backend.threads - 1, worker);
+    } else {
+        for (std::size_t y = 0; y < rows; ++y) {
+            execLine(y);
+        }
+    }
+}
+
+e172::Color renderSample(const RenderViewport &viewport,
+                         const e172::ComplexFunction<double> &function,
+                         std::size_t depth,
+                         const RenderOptions &options,
+                         std::size_t w,
+                         std::size_t h,
+                         std::size_t x,
+                         std::size_t y)
+{
+    if (options.distance.derivative) {
+        double exteriorRadius;
+        return estimateSample(viewport, function, depth, options, w, h, x, y, exteriorRadius);
+    }
+    return finishColor(options,
+                       escapeColor(samplePoint(viewport, w, h, x, y),
+                                   depth,
+                                   function,
+                                   options.colorMask,
+                                   options.julia));
+}
+
+bool render(const RenderViewport &viewport,
+            const e172::ComplexFunction<double> &function,
+            std::size_t depth,
+            const RenderOptions &options,
+            const RenderTarget &target)
+{
+    const auto &region = target.region;
+    if (region.x >= target.width || region.y >= target.height) {
+        return false;
+    }
+    const auto w = region.w ? std::min(region.w, target.width - region.x)
+                            : target.width - region.x;
+    const auto h = region.h ? std::min(region.h, target.height - region.y)
+                            : target.height - region.y;
+    const auto stride = target.stride ? target.stride : w;
+    if (stride < w || target.pixels.size() < (h - 1) * stride + w) {
+        return false;
+    }
+
+    const auto deterioration = std::max<std::size_t>(options.deterioration, 1);
+    // mirror images of a region may lie outside of it
+    const bool symmetric = w == target.width && h == target.height;
+    const SymmetryPlan plan(symmetric ? options.symmetry : Symmetry{},
+                            viewport.offset,
+                            viewport.zoom,
+                            target.width,
+                            target.height,
+                            deterioration);
+    const Pass pass{.viewport = viewport,
+                    .function = function,
+                    .depth = depth,
+                    .options = options,
+                    .target = target,
+                    .plan = plan,
+                    .x = region.x,
+                    .y = region.y,
+                    .w = w,
+                    .h = h,
+                    .stride = stride,
+                    .deterioration = deterioration,
+                    .columnEnd = symmetric ? plan.columnEnd() : region.x + w,
+                    .pixelWidth = 2 / (viewport.zoom * double(target.width)),
+                    .pixelHeight = 2 / (viewport.zoom * double(target.height))};
+
+    const auto firstBand = region.y / deterioration;
+    const auto bands = (region.y + h - 1) / deterioration - firstBand + 1;
+    // the Julia set is connected only when its parameter belongs to the Mandelbrot set
+    const bool fillExterior = options.distance.derivative && options.distance.fillExterior
+                              && (!options.julia
+                                  || escapeLevel(*options.julia, depth, function, std::nullopt)
+                                         >= depth);
+    if (fillExterior) {
+        runRows(options.backend,
+                (bands + distanceBandCells - 1) / distanceBandCells,
+                [&pass](std::size_t i) { pass.distanceBand(i); });
+    } else {
+        runRows(options.backend, bands, [&pass, firstBand](std::size_t i) {
+            pass.band(firstBand + i);
+        });
+    }
+    if (pass.cancelled()) {
+        return false;
+    }
+
+    if (symmetric) {
+        TraceScope scope("mirror");
+        plan.apply(target.pixels.data(), stride, [&pass](std::size_t x, std::size_t y) {
+            return pass.sample(x, y);
+        });
+    }
+    return true;
+}
+
+e172::MatrixFiller<e172::Color> fractalFiller(std::size_t depth,
+                                              e172::Color colorMask,
+                                              const e172::ComplexFunction<double> &function,
+                                              const Symmetry &symmetry,
+                                              const RenderBackend &backend,
+                                              const JuliaParameter &julia,
+                                              const DistanceEstimation &distance,
+                                              std::atomic<std::size_t> *sampled)
+{
+    const RenderOptions options{.colorMask = colorMask,
+                                .symmetry = escapeSymmetry(symmetry, julia),
+                                .julia = julia,
+                                .backend = backend,
+                                .distance = distance,
+                                .sampled = sampled};
+    return [depth, function, options](std::size_t w, std::size_t h, e172::Color *bitmap) {
+        render({}, function, depth, options, {.pixels = {bitmap, w * h}, .width = w, .height = h});
+    };
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "escapetime.h"
+#include "symmetry.h"
+
+#include <atomic>
+#include <cstddef>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+
+/**
+ * @brief The RenderBackend struct - how rows of a frame are spread across threads
+ */
+struct RenderBackend
+{
+    enum class Kind { Serial, ParallelStl, Threads };
+
+    Kind kind = Kind::Serial;
+    /// Threads only
+    std::size_t threads = 1;
+    /// Threads only - rows taken by a thread at once
+    std::size_t bandRows = 1;
+
+    std::string toString() const;
+    static std::string kindName(Kind kind);
+};
+
+/**
+ * @brief runRows - calls execLine for every row in [0, rows) with backend.
+ * Does not allocate after the first call on a thread. Threads runs on the calling thread and
+ * backend.threads - 1 helpers of a process wide pool, which is grown once and then reused
+ */
+void runRows(const RenderBackend &backend,
+             std::size_t rows,
+             const std::function<void(std::size_t)> &execLine);
+
+/**
+ * @brief The RenderViewport struct - pixel (x, y) of a w x h frame shows the sample
+ * ((x / w * 2 - 1) / zoom + offset.x, (y / h * 2 - 1) / zoom + offset.y) as in FractalView.
+ * Default viewport covers [-2, 2] x [-2, 2]
+ */
+struct RenderViewport
+{
+    e172::Vector<double> offset = {};
+    double zoom = 0.5;
+};
+
+/**
+ * @brief The DistanceEstimation struct - when derivative (f' of the rendered function) is set,
+ * pixels are shaded by distance estimate: the set and its boundary get the full color mask,
+ * fading to 0 over distanceShadePixels pixels
+ */
+struct DistanceEstimation
+{
+    e172::ComplexFunction<double> derivative = {};
+    /// disks which the estimate proves to be farther are filled without sampling. Valid only
+    /// for polynomials of degree >= 2. Ignored in Julia mode when the parameter escapes within
+    /// depth: the Julia set is disconnected and the bound does not hold
+    bool fillExterior = false;
+};
+
+/// width of the boundary shading of distance estimation in pixels
+constexpr double distanceShadePixels = 2;
+
+struct RenderOptions
+{
+    e172::Color colorMask = 0xffff0000;
+    /// colors are blended over it when set
+    std::optional<e172::Color> backgroundColor = std::nullopt;
+    /// used when the whole frame is rendered at full quality
+    Symmetry symmetry = {};
+    JuliaParameter julia = std::nullopt;
+    /// pixel block size of a progressive refinement pass, 1 - full quality
+    std::size_t deterioration = 1;
+    RenderBackend backend = {};
+    /// render returns false as soon as possible when it becomes true
+    const std::atomic<bool> *cancelled = nullptr;
+    DistanceEstimation distance = {};
+    /// number of computed samples is added to it when set
+    std::atomic<std::size_t> *sampled = nullptr;
+};
+
+/**
+ * @brief The RenderTarget struct - caller owned pixels of region of a width x height frame.
+ * Pixel (x, y) of the frame is stored at pixels[(y - region.y) * stride + x - region.x]
+ */
+struct RenderTarget
+{
+    struct Region
+    {
+        std::size_t x = 0;
+        std::size_t y = 0;
+        /// 0 - up to the frame edge
+        std::size_t w = 0;
+        std::size_t h = 0;
+    };
+
+    std::span<e172::Color> pixels = {};
+    std::size_t width = 0;
+    std::size_t height = 0;
+    /// 0 - region width
+    std::size_t stride = 0;
+    Region region = {};
+};
+
+/**
+ * @brief render - fills target with escape-time colors of z -> f(z) + c.
+ * Writes only into target, keeps no state between calls and does not allocate (see runRows),
+ * so it is safe to call concurrently from any number of threads with distinct targets
+ * @return false if target is too small or rendering was cancelled
+ */
+bool render(const RenderViewport &viewport,
+            const e172::ComplexFunction<double> &function,
+            std::size_t depth,
+            const RenderOptions &options,
+            const RenderTarget &target);
+
+/**
+ * @brief renderSample - color of pixel (x, y) of a w x h frame, same as render produces
+ */
+e172::Color renderSample(const RenderViewport &viewport,
+                         const e172::ComplexFunction<double> &function,
+                         std::size_t depth,
+                         const RenderOptions &options,
+                         std::size_t w,
+                         std::size_t h,
+                         std::size_t x,
+                         std::size_t y);
+
+/**
+ * @brief fractalFiller - image filler of the whole [-2, 2] x [-2, 2] plane which computes only
+ * the fundamental region of symmetry and mirrors the rest
+ */
+e172::MatrixFiller<e172::Color> fractalFiller(
+    std::size_t depth,
+    e172::Color colorMask,
+    const e172::ComplexFunction<double> &function,
+    const Symmetry &symmetry,
+    const RenderBackend &backend,
+    const JuliaParameter &julia = std::nullopt,
+    const DistanceEstimation &distance = {},
+    std::atomic<std::size_t> *sampled = nullptr);
@@ -0,0 +1,339 @@
+#include "renderjournal.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char journalMagic[8] = {'M', 'B', 'J', 'R', 'N', 'L', '0', '1'};
+
+struct JournalHeader
+{
+    char magic[8];
+    RenderJournal::Parameters parameters;
+};
+
+struct RecordHeader
+{
+    std::uint64_t tile;
+    std::uint64_t checksum;
+};
+
+std::uint64_t checksum(const e172::Color *data, std::size_t size)
+{
+    // FNV-1a over 32 bit words
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool readAll(int fd, void *data, std::size_t size)
+{
+    auto *ptr = static_cast<std::uint8_t *>(data);
+    while (size > 0) {
+        const auto n = ::read(fd, ptr, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void *data, std::size_t size)
+{
+    const auto *ptr = static_cast<const std::uint8_t *>(data);
+    while (size > 0) {
+        const auto n = ::write(fd, ptr, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+} // namespace
+
+void RenderJournal::Parameters::setFunctionName(const std::string &name)
+{
+    std::memset(function, 0, sizeof(function));
+    std::memcpy(function, name.data(), std::min(name.size(), sizeof(function) - 1));
+}
+
+RenderJournal::RenderJournal(const std::string &path, const Parameters &parameters)
+    : m_path(path)
+    , m_parameters(parameters)
+    , m_record(parameters.tileSize * parameters.tileSize)
+{}
+
+RenderJournal::~RenderJournal()
+{
+    if (m_fd >= 0 && m_dirty) {
+        ::fdatasync(m_fd);
+    }
+    closeFile();
+}
+
+bool RenderJournal::start()
+{
+    closeFile();
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+    JournalHeader header;
+    std::memcpy(header.magic, journalMagic, sizeof(journalMagic));
+    header.parameters = m_parameters;
+    if (!writeAll(m_fd, &header, sizeof(header)) || ::fdatasync(m_fd) != 0) {
+        closeFile();
+        return false;
+    }
+    m_lastSync = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool RenderJournal::open(std::string &error)
+{
+    closeFile();
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (m_fd < 0) {
+        error = "journal '" + m_path + "' not found";
+        return false;
+    }
+    JournalHeader header;
+    if (!readAll(m_fd, &header, sizeof(header))
+        || std::memcmp(header.magic, journalMagic, sizeof(journalMagic)) != 0) {
+        error = "'" + m_path + "' is not a render journal";
+        closeFile();
+        return false;
+    }
+    if (std::memcmp(&header.parameters, &m_parameters, sizeof(m_parameters)) != 0) {
+        error = "journal '" + m_path + "' was written with different parameters (function: "
+                + std::string(header.parameters.function,
+                              strnlen(header.parameters.function,
+                                      sizeof(header.parameters.function)))
+                + ", resolution: " + std::to_string(header.parameters.resolution)
+                + ", depth: " + std::to_string(header.parameters.depth) + ")";
+        closeFile();
+        return false;
+    }
+    m_lastSync = std::chrono::steady_clock::now();
+    return true;
+}
+
+std::size_t RenderJournal::restore(e172::Color *bitmap, std::vector<bool> &done)
+{
+    TraceScope scope("journal_restore");
+    std::lock_guard lock(m_mutex);
+    const auto resolution = m_parameters.resolution;
+    const auto tileCount = m_parameters.tileCount();
+    done.resize(tileCount, false);
+
+    std::size_t restored = 0;
+    off_t end = sizeof(JournalHeader);
+    ::lseek(m_fd, end, SEEK_SET);
+    RecordHeader record;
+    while (readAll(m_fd, &record, sizeof(record)) && record.tile < tileCount) {
+        const auto rect = tileRect(record.tile);
+        const auto size = rect.w * rect.h;
+        if (!readAll(m_fd, m_record.data(), size * sizeof(e172::Color))
+            || checksum(m_record.data(), size) != record.checksum) {
+            break;
+        }
+        for (std::size_t y = 0; y < rect.h; ++y) {
+            std::copy_n(m_record.data() + y * rect.w,
+                        rect.w,
+                        bitmap + (rect.y + y) * resolution + rect.x);
+        }
+        restored += done[record.tile] ? 0 : 1;
+        done[record.tile] = true;
+        end += sizeof(record) + size * sizeof(e172::Color);
+    }
+
+    // drop torn tail so that new records follow the last complete one
+    [[maybe_unused]] const auto truncated = ::ftruncate(m_fd, end);
+    ::lseek(m_fd, end, SEEK_SET);
+    return restored;
+}
+
+void RenderJournal::commit(std::size_t tile, const e172::Color *bitmap)
+{
+    TraceScope scope("journal_commit", std::int64_t(tile));
+    const auto begin = std::chrono::steady_clock::now();
+    const auto rect = tileRect(tile);
+    const auto resolution = m_parameters.resolution;
+
+    int syncFd = -1;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_fd < 0) {
+            return;
+        }
+        for (std::size_t y = 0; y < rect.h; ++y) {
+            std::copy_n(bitmap + (rect.y + y) * resolution + rect.x,
+                        rect.w,
+                        m_record.data() + y * rect.w);
+        }
+        RecordHeader record{.tile = tile,
+                            .checksum = checksum(m_record.data(), rect.w * rect.h)};
+        iovec parts[] = {{&record, sizeof(record)},
+                         {m_record.data(), rect.w * rect.h * sizeof(e172::Color)}};
+        const auto expected = parts[0].iov_len + parts[1].iov_len;
+        if (::writev(m_fd, parts, 2) != ssize_t(expected)) {
+            // a short record is dropped by restore, the tile will be recomputed on resume
+            return;
+        }
+        m_dirty = true;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - m_lastSync >= syncInterval) {
+            // claim the batch, the sync itself runs unlocked so other tiles keep committing
+            syncFd = m_fd;
+            m_lastSync = now;
+            m_dirty = false;
+        }
+    }
+    if (syncFd >= 0) {
+        TraceScope scope("journal_sync");
+        ::fdatasync(syncFd);
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_overhead += std::chrono::steady_clock::now() - begin;
+}
+
+void RenderJournal::finish()
+{
+    std::lock_guard lock(m_mutex);
+    closeFile();
+    ::unlink(m_path.c_str());
+}
+
+std::chrono::steady_clock::duration RenderJournal::overhead() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_overhead;
+}
+
+RenderJournal::Rect RenderJournal::tileRect(std::size_t tile) const
+{
+    const auto tilesPerSide = m_parameters.tilesPerSide();
+    const auto tileSize = m_parameters.tileSize;
+    const auto x = (tile % tilesPerSide) * tileSize;
+    const auto y = (tile / tilesPerSide) * tileSize;
+    return Rect{.x = x,
+                .y = y,
+                .w = std::min<std::size_t>(tileSize, m_parameters.resolution - x),
+                .h = std::min<std::size_t>(tileSize, m_parameters.resolution - y)};
+}
+
+void RenderJournal::closeFile()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+e172::MatrixFiller<e172::Color> journaledFractalFiller(
+    std::size_t depth,
+    e172::Color colorMask,
+    const e172::ComplexFunction<double> &function,
+    const Symmetry &symmetry,
+    const RenderBackend &backend,
+    RenderJournal &journal,
+    bool resume,
+    const JuliaParameter &julia,
+    const DistanceEstimation &distance,
+    std::atomic<std::size_t> *sampled)
+{
+    // tiles are rendered as regions, the plan of the whole image mirrors them afterwards
+    const RenderOptions options{.colorMask = colorMask,
+                                .julia = julia,
+                                .distance = distance,
+                                .sampled = sampled};
+    return [depth, function, symmetry, backend, &journal, resume, options](
+               std::size_t w, std::size_t h, e172::Color *bitmap) {
+        const RenderViewport viewport;
+        const SymmetryPlan plan(escapeSymmetry(symmetry, options.julia),
+                                viewport.offset,
+                                viewport.zoom,
+                                w,
+                                h);
+
+        const auto &parameters = journal.parameters();
+        std::vector<bool> done(parameters.tileCount(), false);
+        if (resume) {
+            const auto restored = journal.restore(bitmap, done);
+            std::cout << "Restored " << restored << " of " << done.size() << " tiles from "
+                      << journal.path() << std::endl;
+        }
+
+        std::vector<std::size_t> job;
+        for (std::size_t tile = 0; tile < done.size(); ++tile) {
+            if (!done[tile]) {
+                job.push_back(tile);
+            }
+        }
+
+        const auto tilesPerSide = parameters.tilesPerSide();
+        const auto tileSize = parameters.tileSize;
+        const auto exec_tile = [&](std::size_t tile) {
+            TraceScope scope("tile", std::int64_t(tile));
+            const auto tx = (tile % tilesPerSide) * tileSize;
+            const auto ty = (tile / tilesPerSide) * tileSize;
+            const auto xEnd = std::min<std::size_t>(std::min(tx + tileSize, w), plan.columnEnd());
+            const auto yEnd = std::min<std::size_t>(ty + tileSize, h);
+            bool computed = false;
+            // mirrored rows are contiguous, so a tile has at most two runs of computed rows
+            for (auto y = ty; y < yEnd && tx < xEnd;) {
+                if (plan.rowMirrored(y)) {
+                    ++y;
+                    continue;
+                }
+                auto runEnd = y + 1;
+                while (runEnd < yEnd && !plan.rowMirrored(runEnd)) {
+                    ++runEnd;
+                }
+                render(viewport,
+                       function,
+                       depth,
+                       options,
+                       {.pixels = {bitmap + y * w + tx, (runEnd - y - 1) * w + xEnd - tx},
+                        .width = w,
+                        .height = h,
+                        .stride = w,
+                        .region = {.x = tx, .y = y, .w = xEnd - tx, .h = runEnd - y}});
+                computed = true;
+                y = runEnd;
+            }
+            // fully mirrored tiles are filled by plan.apply and need no checkpoint
+            if (computed) {
+                journal.commit(tile, bitmap);
+            }
+        };
+
+        // tiles are spread across threads, every tile is rendered serially
+        runRows(backend, job.size(), [&job, &exec_tile](std::size_t i) { exec_tile(job[i]); });
+        TraceScope scope("mirror");
+        plan.apply(bitmap, w, [&](std::size_t x, std::size_t y) {
+            return renderSample(viewport, function, depth, options, w, h, x, y);
+        });
+    };
+}
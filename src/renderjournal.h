@@ -0,0 +1,123 @@
+#pragma once
+
+#include "escapetime.h"
+#include "renderengine.h"
+#include "symmetry.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The RenderJournal class checkpoints finished tiles of a write mode render so that a
+ * killed render can be resumed.
+ *
+ * File layout: Header, then records of (uint64 tile, uint64 checksum, tile pixels).
+ * Records are appended as tiles finish and synced to disk in batches (at most every
+ * syncInterval). A torn last record is detected by its checksum and dropped on resume.
+ */
+class RenderJournal
+{
+public:
+    struct Parameters
+    {
+        std::uint64_t resolution = 0;
+        std::uint64_t tileSize = 256;
+        std::uint64_t depth = 0;
+        std::uint32_t colorMask = 0;
+        /// 1 in Julia mode
+        std::uint32_t julia = 0;
+        double juliaParameter[2] = {};
+        char function[64] = {};
+
+        void setFunctionName(const std::string &name);
+        std::uint64_t tilesPerSide() const { return (resolution + tileSize - 1) / tileSize; }
+        std::uint64_t tileCount() const { return tilesPerSide() * tilesPerSide(); }
+    };
+
+    static constexpr std::chrono::seconds syncInterval = std::chrono::seconds(5);
+
+    RenderJournal(const std::string &path, const Parameters &parameters);
+    RenderJournal(const RenderJournal &) = delete;
+    ~RenderJournal();
+
+    const std::string &path() const { return m_path; }
+    const Parameters &parameters() const { return m_parameters; }
+
+    /**
+     * @brief start - creates empty journal (overwrites existing one)
+     */
+    bool start();
+
+    /**
+     * @brief open - opens existing journal and checks that it was written with the same
+     * parameters
+     * @return false if journal is missing, unreadable or parameters differ
+     */
+    bool open(std::string &error);
+
+    /**
+     * @brief restore - loads tiles of opened journal into bitmap (resolution x resolution).
+     * A torn last record is cut off, new records are appended after the restored ones
+     * @param done - set to true for every restored tile
+     * @return number of restored tiles
+     */
+    std::size_t restore(e172::Color *bitmap, std::vector<bool> &done);
+
+    /**
+     * @brief commit - appends tile from bitmap. Thread safe, a due sync runs outside the lock
+     */
+    void commit(std::size_t tile, const e172::Color *bitmap);
+
+    /**
+     * @brief finish - syncs and removes journal (call after the image is saved)
+     */
+    void finish();
+
+    /**
+     * @brief overhead - time spent in commit summed over all calling threads
+     */
+    std::chrono::steady_clock::duration overhead() const;
+
+private:
+    struct Rect
+    {
+        std::size_t x, y, w, h;
+    };
+
+    Rect tileRect(std::size_t tile) const;
+    void closeFile();
+
+private:
+    std::string m_path;
+    Parameters m_parameters;
+    int m_fd = -1;
+
+    mutable std::mutex m_mutex;
+    std::vector<e172::Color> m_record;
+    std::chrono::steady_clock::time_point m_lastSync;
+    bool m_dirty = false;
+    std::chrono::steady_clock::duration m_overhead{};
+};
+
+/**
+ * @brief journaledFractalFiller - like fractalFiller but computes the image tile by tile,
+ * commits each finished tile to journal. When resume is true tiles of the opened journal are
+ * restored instead of computed. Image size must be journal.parameters().resolution
+ */
+e172::MatrixFiller<e172::Color> journaledFractalFiller(
+    std::size_t depth,
+    e172::Color colorMask,
+    const e172::ComplexFunction<double> &function,
+    const Symmetry &symmetry,
+    const RenderBackend &backend,
+    RenderJournal &journal,
+    bool resume,
+    const JuliaParameter &julia = std::nullopt,
+    const DistanceEstimation &distance = {},
+    std::atomic<std::size_t> *sampled = nullptr);
@@ -0,0 +1,164 @@
+#include "complexfunctions.h"
+#include "renderengine.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Compares render() with a plain per pixel reference (escapeColor, or renderSample in distance
+ * estimation mode, which samples every pixel without exterior fill) on every backend.
+ * Returns non zero if any pixel differs
+ */
+
+namespace {
+
+struct Case
+{
+    std::string name;
+    std::string function = "sqr";
+    RenderViewport viewport = {};
+    std::size_t depth = 64;
+    RenderOptions options = {};
+    std::size_t size = 256;
+    RenderTarget::Region region = {};
+};
+
+e172::Color referenceColor(const Case &c, std::size_t x, std::size_t y)
+{
+    const auto &entry = complexFunctions().at(c.function);
+    // a coarse pass shows the sample of the top left pixel of every block
+    const auto d = std::max<std::size_t>(c.options.deterioration, 1);
+    const auto sx = x - x % d;
+    const auto sy = y - y % d;
+    if (c.options.distance.derivative) {
+        return renderSample(c.viewport, entry.function, c.depth, c.options, c.size, c.size, sx, sy);
+    }
+    const auto value = e172::Vector(double(sx) / double(c.size) * 2 - 1,
+                                    double(sy) / double(c.size) * 2 - 1)
+                           / c.viewport.zoom
+                       + c.viewport.offset;
+    const auto color = escapeColor(value.toComplex(),
+                                   c.depth,
+                                   entry.function,
+                                   c.options.colorMask,
+                                   c.options.julia);
+    return c.options.backgroundColor ? e172::blend(color, *c.options.backgroundColor) : color;
+}
+
+bool check(const Case &c, const RenderBackend &backend)
+{
+    const auto &entry = complexFunctions().at(c.function);
+    const auto w = c.region.w ? c.region.w : c.size - c.region.x;
+    const auto h = c.region.h ? c.region.h : c.size - c.region.y;
+    auto options = c.options;
+    options.backend = backend;
+    std::vector<e172::Color> pixels(w * h);
+    if (!render(c.viewport,
+                entry.function,
+                c.depth,
+                options,
+                {.pixels = pixels, .width = c.size, .height = c.size, .region = c.region})) {
+        std::cout << "FAIL " << c.name << " (" << backend.toString() << "): render failed\n";
+        return false;
+    }
+
+    std::size_t mismatches = 0;
+    for (std::size_t y = 0; y < h; ++y) {
+        for (std::size_t x = 0; x < w; ++x) {
+            const auto expected = referenceColor(c, c.region.x + x, c.region.y + y);
+            if (pixels[y * w + x] != expected && mismatches++ == 0) {
+                std::cout << "FAIL " << c.name << " (" << backend.toString() << "): pixel ("
+                          << c.region.x + x << ", " << c.region.y + y << ") is 0x" << std::hex
+                          << pixels[y * w + x] << " instead of 0x" << expected << std::dec
+                          << "\n";
+            }
+        }
+    }
+    if (mismatches > 0) {
+        std::cout << "FAIL " << c.name << " (" << backend.toString() << "): " << mismatches
+                  << " of " << w * h << " pixels differ\n";
+        return false;
+    }
+    return true;
+}
+
+DistanceEstimation distanceEstimation(const std::string &function)
+{
+    const auto &entry = complexFunctions().at(function);
+    return {.derivative = entry.derivative, .fillExterior = entry.polynomial};
+}
+
+std::vector<Case> cases()
+{
+    const auto sqrSymmetry = complexFunctions().at("sqr").symmetry;
+    return {
+        {.name = "whole frame", .options = {.symmetry = sqrSymmetry}},
+        {.name = "background",
+         .options = {.colorMask = 0x80ff8000, .backgroundColor = 0xff202020}},
+        {.name = "region", .size = 512, .region = {.x = 130, .y = 60, .w = 100, .h = 90}},
+        {.name = "off center",
+         .viewport = {.offset = {-0.75, 0.1}, .zoom = 4},
+         .options = {.symmetry = sqrSymmetry}},
+        // coarse passes must not take rows from the mirrored half (stale previous frame)
+        {.name = "coarse pass",
+         .options = {.symmetry = sqrSymmetry, .deterioration = 4}},
+        {.name = "coarse pass off center",
+         .viewport = {.offset = {-0.5, 0.05}, .zoom = 2},
+         .options = {.symmetry = sqrSymmetry, .deterioration = 3},
+         .size = 250},
+        {.name = "julia", .options = {.julia = e172::Complex<double>(-0.8, 0.156)}},
+        {.name = "distance", .depth = 256, .options = {.distance = distanceEstimation("sqr")}},
+        {.name = "distance off center",
+         .viewport = {.offset = {-0.1, 0.9}, .zoom = 8},
+         .depth = 256,
+         .options = {.distance = distanceEstimation("sqr")}},
+        {.name = "distance region",
+         .depth = 256,
+         .options = {.distance = distanceEstimation("sqr")},
+         .size = 512,
+         .region = {.x = 40, .y = 300, .w = 200, .h = 150}},
+        // the exterior bound needs degree >= 2 and a connected Julia set (c in the Mandelbrot set)
+        {.name = "distance x",
+         .function = "x",
+         .depth = 1024,
+         .options = {.distance = distanceEstimation("x")},
+         .size = 512},
+        {.name = "distance julia connected",
+         .depth = 1024,
+         .options = {.julia = e172::Complex<double>(-0.12, 0.75),
+                     .distance = distanceEstimation("sqr")},
+         .size = 512},
+        {.name = "distance julia disconnected",
+         .depth = 1024,
+         .options = {.julia = e172::Complex<double>(0.5, 0), .distance = distanceEstimation("sqr")},
+         .size = 512},
+        {.name = "distance julia disconnected near boundary",
+         .depth = 1024,
+         .options = {.julia = e172::Complex<double>(-0.75, 0.2),
+                     .distance = distanceEstimation("sqr")},
+         .size = 512},
+    };
+}
+
+} // namespace
+
+int main()
+{
+    const RenderBackend backends[] = {{.kind = RenderBackend::Kind::Serial},
+                                      {.kind = RenderBackend::Kind::ParallelStl},
+                                      {.kind = RenderBackend::Kind::Threads,
+                                       .threads = 4,
+                                       .bandRows = 3}};
+    std::size_t failed = 0;
+    const auto all = cases();
+    for (const auto &c : all) {
+        for (const auto &backend : backends) {
+            failed += check(c, backend) ? 0 : 1;
+        }
+    }
+    const auto total = all.size() * std::size(backends);
+    std::cout << (failed == 0 ? "OK" : "FAILED") << ": " << total - failed << " of " << total
+              << " checks passed\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief percentile - nearest rank p-quantile (p in [0, 1]) of values, 0 if there are none
+ */
+inline double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    const auto n = std::min(values.size() - 1, std::size_t(p * double(values.size())));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
@@ -0,0 +1,88 @@
+#include "symmetry.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/**
+ * @brief gridAxis - position k of the axis mirror on the pixel grid, so that pixel i is
+ * mirrored to pixel k - i. Returns -1 if the axis is not on the grid
+ */
+std::ptrdiff_t gridAxis(double offset, double zoom, std::size_t size)
+{
+    const auto axis = double(size) * (1 - offset * zoom);
+    const auto rounded = std::round(axis);
+    if (std::abs(axis - rounded) > 1e-9 * double(size) || rounded < 0) {
+        return -1;
+    }
+    return std::ptrdiff_t(rounded);
+}
+
+} // namespace
+
+SymmetryPlan::SymmetryPlan(const Symmetry &symmetry,
+                           const e172::Vector<double> &offset,
+                           double zoom,
+                           std::size_t w,
+                           std::size_t h,
+                           std::size_t deterioration)
+    : m_w(w)
+    , m_h(h)
+    , m_columnEnd(w)
+{
+    if (deterioration > 1) {
+        return;
+    }
+
+    const auto rowAxis = gridAxis(offset.y(), zoom, h);
+    const bool centredColumns = gridAxis(offset.x(), zoom, w) == std::ptrdiff_t(w);
+
+    if (rowAxis >= 0) {
+        if (symmetry.conjugate) {
+            m_rowMirror = true;
+        } else if (symmetry.pointReflection() && centredColumns) {
+            m_rowMirror = true;
+            m_rowReversed = true;
+        }
+        m_rowAxis = std::size_t(rowAxis);
+    }
+
+    // conjugate + point reflection = reflection about the imaginary axis
+    if (symmetry.conjugate && symmetry.pointReflection() && centredColumns && w > 0) {
+        m_columnEnd = w / 2 + 1;
+    }
+}
+
+void SymmetryPlan::apply(
+    e172::Color *bitmap,
+    std::size_t stride,
+    const std::function<e172::Color(std::size_t x, std::size_t y)> &fallback) const
+{
+    if (m_columnEnd < m_w) {
+        for (std::size_t y = 0; y < m_h; ++y) {
+            if (!rowMirrored(y)) {
+                // pixel x takes pixel w - x
+                auto *row = bitmap + y * stride;
+                std::reverse_copy(row + 1, row + m_w - m_columnEnd + 1, row + m_columnEnd);
+            }
+        }
+    }
+
+    if (!m_rowMirror) {
+        return;
+    }
+    for (std::size_t y = 0; y < m_h; ++y) {
+        if (!rowMirrored(y)) {
+            continue;
+        }
+        const auto *source = bitmap + (m_rowAxis - y) * stride;
+        auto *row = bitmap + y * stride;
+        if (m_rowReversed) {
+            row[0] = fallback(0, y);
+            std::reverse_copy(source + 1, source + m_w, row + 1);
+        } else {
+            std::copy(source, source + m_w, row);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <functional>
+
+/**
+ * @brief The Symmetry struct describes symmetries of the escape-time set of z -> f(z) + c
+ * in the c plane.
+ * conjugate - set is mirror-symmetric about the real axis (f(conj(z)) = conj(f(z)))
+ * rotation - set is invariant under rotation by 2pi / rotation around 0 (1 - no rotation)
+ */
+struct Symmetry
+{
+    bool conjugate = false;
+    std::size_t rotation = 1;
+
+    bool pointReflection() const { return rotation % 2 == 0; }
+};
+
+/**
+ * @brief The SymmetryPlan class splits a w x h viewport into the fundamental region which has
+ * to be computed and the part which is mirrored from it.
+ * Pixel (x, y) maps to ((x / w * 2 - 1) / zoom + offset.x, (y / h * 2 - 1) / zoom + offset.y)
+ * as in FractalView. Rows are mirrored when the real axis falls on the pixel grid, columns when
+ * the imaginary axis falls exactly on column w / 2.
+ * A coarse pass (deterioration > 1) shows the top left sample of every block, and the mirror
+ * image of a block is not a block of the pass, so such a plan mirrors nothing.
+ */
+class SymmetryPlan
+{
+public:
+    SymmetryPlan(const Symmetry &symmetry,
+                 const e172::Vector<double> &offset,
+                 double zoom,
+                 std::size_t w,
+                 std::size_t h,
+                 std::size_t deterioration = 1);
+
+    /**
+     * @brief rowMirrored - true if row y is filled by apply and must not be computed
+     */
+    bool rowMirrored(std::size_t y) const
+    {
+        return m_rowMirror && y < m_h && y <= m_rowAxis && m_rowAxis - y < y;
+    }
+
+    /**
+     * @brief columnEnd - columns [0, columnEnd) of not mirrored rows must be computed
+     */
+    std::size_t columnEnd() const { return m_columnEnd; }
+
+    /**
+     * @brief apply - fills mirrored pixels of bitmap after the fundamental region was computed
+     * @param stride - bitmap row length
+     * @param fallback - computes pixel which has no mirror inside the viewport
+     */
+    void apply(e172::Color *bitmap,
+               std::size_t stride,
+               const std::function<e172::Color(std::size_t x, std::size_t y)> &fallback) const;
+
+private:
+    std::size_t m_w;
+    std::size_t m_h;
+    bool m_rowMirror = false;
+    bool m_rowReversed = false;
+    /// mirrored row of y is m_rowAxis - y
+    std::size_t m_rowAxis = 0;
+    std::size_t m_columnEnd;
+};
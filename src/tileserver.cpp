@@ -0,0 +1,668 @@
+#include "tileserver.h"
+
+#include "fractalview.h"
+#include "pngencoder.h"
+#include "renderengine.h"
+#include "statistics.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <csignal>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t maxRequestSize = 8192;
+constexpr std::size_t latencyWindow = 65536;
+constexpr std::uint32_t maxZoomLevel = 40;
+/// connections that do not send a full request in time are dropped
+constexpr auto readTimeout = std::chrono::seconds(10);
+
+std::atomic<bool> interrupted = false;
+
+void interrupt(int)
+{
+    interrupted = true;
+}
+
+bool setNonBlocking(int fd)
+{
+    const int flags = ::fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+template<typename T>
+bool parseNumber(std::string_view &str, T &result)
+{
+    const auto r = std::from_chars(str.data(), str.data() + str.size(), result);
+    if (r.ec != std::errc() || r.ptr == str.data()) {
+        return false;
+    }
+    str.remove_prefix(r.ptr - str.data());
+    return true;
+}
+
+bool consume(std::string_view &str, std::string_view prefix)
+{
+    if (!str.starts_with(prefix)) {
+        return false;
+    }
+    str.remove_prefix(prefix.size());
+    return true;
+}
+
+} // namespace
+
+TileServer::TileServer(const e172::ComplexFunction<double> &function, const Settings &settings)
+    : m_function(function)
+    , m_settings(settings)
+{
+    if (m_settings.workerCount == 0) {
+        m_settings.workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::ostringstream root;
+    root << m_settings.cacheDir << "/" << m_settings.functionName << "_D"
+         << m_settings.depthMultiplier << "_T" << m_settings.tileSize << "_" << std::hex
+         << m_settings.colorMask << "_" << m_settings.backgroundColor;
+    m_cacheRoot = root.str();
+}
+
+TileServer::~TileServer()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+
+    for (const auto &connection : m_connections) {
+        ::close(connection.first);
+    }
+    m_connections.clear();
+    const auto closeFd = [](int &fd) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    };
+    closeFd(m_listenFd);
+    closeFd(m_wakePipe[0]);
+    closeFd(m_wakePipe[1]);
+}
+
+int TileServer::exec()
+{
+    m_listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        std::cerr << "error: Can not create socket.\n";
+        return 1;
+    }
+    const int reuse = 1;
+    ::setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(m_settings.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(m_listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+        || ::listen(m_listenFd, SOMAXCONN) != 0 || !setNonBlocking(m_listenFd)) {
+        std::cerr << "error: Can not listen on 127.0.0.1:" << m_settings.port << ".\n";
+        return 1;
+    }
+    if (::pipe(m_wakePipe) != 0 || !setNonBlocking(m_wakePipe[0])
+        || !setNonBlocking(m_wakePipe[1])) {
+        std::cerr << "error: Can not create wake pipe.\n";
+        return 1;
+    }
+
+    std::signal(SIGINT, interrupt);
+    std::signal(SIGTERM, interrupt);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    for (std::size_t i = 0; i < m_settings.workerCount; ++i) {
+        m_workers.emplace_back([this] { workerLoop(); });
+    }
+
+    std::cout << "Serving tiles on http://127.0.0.1:" << m_settings.port
+              << "/{z}/{x}/{y}.png (stats: /stats), workers: " << m_settings.workerCount
+              << ", queue: " << m_settings.queueCapacity << ", cache: " << m_cacheRoot
+              << std::endl;
+
+    auto lastReport = Clock::now();
+    std::size_t lastReportedRequests = 0;
+    std::vector<pollfd> fds;
+    while (!interrupted) {
+        fds.clear();
+        fds.push_back({m_listenFd, POLLIN, 0});
+        fds.push_back({m_wakePipe[0], POLLIN, 0});
+        for (const auto &[fd, connection] : m_connections) {
+            fds.push_back(
+                {fd, short(connection.state == ConnectionState::Writing ? POLLOUT : POLLIN), 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+            std::cerr << "error: poll failed.\n";
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char buffer[256];
+            while (::read(m_wakePipe[0], buffer, sizeof(buffer)) > 0) {
+            }
+            dispatchCompletions();
+        }
+
+        for (auto it = fds.begin() + 2; it != fds.end(); ++it) {
+            if (it->revents == 0) {
+                continue;
+            }
+            const auto connection = m_connections.find(it->fd);
+            if (connection == m_connections.end()) {
+                continue;
+            }
+            switch (connection->second.state) {
+            case ConnectionState::Reading:
+                readRequest(connection->second);
+                break;
+            case ConnectionState::Waiting: {
+                char buffer[256];
+                const auto size = ::recv(it->fd, buffer, sizeof(buffer), 0);
+                if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    // client abandoned the tile
+                    detach(connection->second);
+                    closeConnection(it->fd);
+                }
+                break;
+            }
+            case ConnectionState::Writing:
+                writeResponse(connection->second);
+                break;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            acceptConnections();
+        }
+
+        dropIdleConnections();
+
+        if (Clock::now() - lastReport > std::chrono::seconds(10)
+            && m_requests != lastReportedRequests) {
+            printStats();
+            lastReport = Clock::now();
+            lastReportedRequests = m_requests;
+        }
+    }
+
+    std::cout << "\nStopping tile server." << std::endl;
+    printStats();
+    return 0;
+}
+
+void TileServer::workerLoop()
+{
+    if (Tracer::enabled()) {
+        Tracer::setThreadName("tile worker");
+    }
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock lock(m_mutex);
+            m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) {
+                return;
+            }
+
+            // jobs without waiters were abandoned - they only run if somebody asks again
+            const auto it = std::find_if(m_queue.begin(), m_queue.end(), [](const auto &job) {
+                return job->waiters > 0;
+            });
+            if (it == m_queue.end()) {
+                for (const auto &abandoned : m_queue) {
+                    m_jobs.erase(abandoned->key);
+                }
+                m_cancelled += m_queue.size();
+                m_queue.clear();
+                continue;
+            }
+            job = *it;
+            m_queue.erase(it);
+            job->running = true;
+        }
+
+        bool cancelled;
+        const auto png = produceTile(*job, cancelled);
+
+        {
+            std::lock_guard lock(m_mutex);
+            job->running = false;
+            // the flag alone is not enough: a coalesced request may have reset it meanwhile
+            if (cancelled) {
+                if (job->waiters > 0) {
+                    job->cancelled = false;
+                    m_queue.push_front(job);
+                    m_queueCondition.notify_one();
+                } else {
+                    m_jobs.erase(job->key);
+                    ++m_cancelled;
+                }
+                continue;
+            }
+            m_jobs.erase(job->key);
+            m_completions.push_back({job->key, png});
+        }
+        const char wake = 0;
+        [[maybe_unused]] const auto size = ::write(m_wakePipe[1], &wake, 1);
+    }
+}
+
+std::shared_ptr<const std::string> TileServer::produceTile(Job &job, bool &cancelled)
+{
+    cancelled = false;
+    const auto path = tilePath(job.key);
+    const auto readFile = [](const std::string &path) -> std::shared_ptr<const std::string> {
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream) {
+            return nullptr;
+        }
+        auto data = std::make_shared<std::string>(std::istreambuf_iterator<char>(stream),
+                                                  std::istreambuf_iterator<char>());
+        return data->empty() ? nullptr : data;
+    };
+
+    if (const auto png = readFile(path)) {
+        ++m_diskHits;
+        cacheInsert(job.key, png);
+        return png;
+    }
+
+    std::vector<e172::Color> pixels(m_settings.tileSize * m_settings.tileSize);
+    if (!renderTile(job, pixels)) {
+        cancelled = true;
+        return nullptr;
+    }
+
+    std::shared_ptr<const std::string> png;
+    {
+        TraceScope scope("encode");
+        auto data = encodePng(pixels.data(), m_settings.tileSize, m_settings.tileSize);
+        if (data.empty()) {
+            std::cerr << "error: Can not encode tile '" << path << "'.\n";
+            return nullptr;
+        }
+        png = std::make_shared<const std::string>(std::move(data));
+    }
+    ++m_rendered;
+    cacheInsert(job.key, png);
+
+    // the disk cache is best effort, the tile is served from memory anyway
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    const auto partPath = path + ".part.png";
+    {
+        std::ofstream stream(partPath, std::ios::binary);
+        stream.write(png->data(), std::streamsize(png->size()));
+        if (!stream) {
+            ec = std::make_error_code(std::errc::io_error);
+        }
+    }
+    if (ec || (std::filesystem::rename(partPath, path, ec), ec)) {
+        std::cerr << "error: Can not write tile '" << path << "'.\n";
+        std::filesystem::remove(partPath, ec);
+    }
+    return png;
+}
+
+bool TileServer::renderTile(const Job &job, std::vector<e172::Color> &pixels) const
+{
+    const auto tileSize = m_settings.tileSize;
+    const auto tiles = std::ldexp(1., job.key.z);
+    const auto depth = FractalView::expRoof(double(m_settings.depthMultiplier) * 0.5 * tiles);
+    const auto frameSize = tileSize << job.key.z;
+    TraceScope scope("tile", std::int64_t(job.key.z));
+
+    // the whole zoom level is one frame of the [-2, 2] x [-2, 2] plane, tile is its region
+    const RenderOptions options{.colorMask = m_settings.colorMask,
+                                .backgroundColor = m_settings.backgroundColor,
+                                .cancelled = &job.cancelled};
+    return render({},
+                  m_function,
+                  std::size_t(depth),
+                  options,
+                  {.pixels = pixels,
+                   .width = frameSize,
+                   .height = frameSize,
+                   .region = {.x = job.key.x * tileSize,
+                              .y = job.key.y * tileSize,
+                              .w = tileSize,
+                              .h = tileSize}});
+}
+
+std::string TileServer::tilePath(const TileKey &key) const
+{
+    return m_cacheRoot + "/" + std::to_string(key.z) + "/" + std::to_string(key.x) + "/"
+           + std::to_string(key.y) + ".png";
+}
+
+std::shared_ptr<const std::string> TileServer::cacheLookup(const TileKey &key)
+{
+    std::lock_guard lock(m_cacheMutex);
+    const auto it = m_cache.find(key);
+    if (it == m_cache.end()) {
+        return nullptr;
+    }
+    m_cacheOrder.splice(m_cacheOrder.begin(), m_cacheOrder, it->second);
+    return it->second->second;
+}
+
+void TileServer::cacheInsert(const TileKey &key, std::shared_ptr<const std::string> png)
+{
+    std::lock_guard lock(m_cacheMutex);
+    const auto it = m_cache.find(key);
+    if (it != m_cache.end()) {
+        m_cacheOrder.erase(it->second);
+        m_cache.erase(it);
+    }
+    m_cacheOrder.emplace_front(key, std::move(png));
+    m_cache[key] = m_cacheOrder.begin();
+    while (m_cache.size() > m_settings.memoryCacheCapacity) {
+        m_cache.erase(m_cacheOrder.back().first);
+        m_cacheOrder.pop_back();
+    }
+}
+
+void TileServer::acceptConnections()
+{
+    for (;;) {
+        const int fd = ::accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        if (!setNonBlocking(fd)) {
+            ::close(fd);
+            continue;
+        }
+        Connection connection;
+        connection.fd = fd;
+        connection.begin = Clock::now();
+        connection.lastActivity = connection.begin;
+        m_connections.emplace(fd, std::move(connection));
+    }
+}
+
+void TileServer::readRequest(Connection &connection)
+{
+    char buffer[2048];
+    for (;;) {
+        const auto size = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (size > 0) {
+            connection.in.append(buffer, size);
+            connection.lastActivity = Clock::now();
+            if (connection.in.size() > maxRequestSize) {
+                respond(connection, "431 Request Header Fields Too Large", "text/plain", "");
+                return;
+            }
+        } else if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            closeConnection(connection.fd);
+            return;
+        }
+    }
+
+    const auto headerEnd = connection.in.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        return;
+    }
+
+    std::istringstream requestLine(connection.in.substr(0, connection.in.find("\r\n")));
+    std::string method, target;
+    requestLine >> method >> target;
+    if (method != "GET") {
+        respond(connection, "405 Method Not Allowed", "text/plain", "");
+        return;
+    }
+    connection.begin = Clock::now();
+    handleRequest(connection, target.substr(0, target.find('?')));
+}
+
+void TileServer::handleRequest(Connection &connection, const std::string &target)
+{
+    if (target == "/stats") {
+        respond(connection, "200 OK", "application/json", statsJson());
+        return;
+    }
+
+    std::string_view str = target;
+    TileKey key{};
+    if (!consume(str, "/") || !parseNumber(str, key.z) || !consume(str, "/")
+        || !parseNumber(str, key.x) || !consume(str, "/") || !parseNumber(str, key.y)
+        || !consume(str, ".png") || !str.empty() || key.z > maxZoomLevel
+        || key.x >= (std::uint64_t(1) << key.z) || key.y >= (std::uint64_t(1) << key.z)) {
+        respond(connection, "404 Not Found", "text/plain", "");
+        return;
+    }
+
+    ++m_requests;
+    connection.tileRequest = true;
+    connection.key = key;
+
+    if (const auto png = cacheLookup(key)) {
+        ++m_memoryHits;
+        respond(connection, "200 OK", "image/png", *png);
+    } else if (enqueue(connection)) {
+        connection.state = ConnectionState::Waiting;
+        m_waiting.emplace(key, connection.fd);
+    } else {
+        ++m_rejected;
+        respond(connection, "503 Service Unavailable", "text/plain", "");
+    }
+}
+
+bool TileServer::enqueue(Connection &connection)
+{
+    std::lock_guard lock(m_mutex);
+    const auto it = m_jobs.find(connection.key);
+    if (it != m_jobs.end()) {
+        ++m_coalesced;
+        ++it->second->waiters;
+        it->second->cancelled = false;
+        return true;
+    }
+
+    if (m_queue.size() >= m_settings.queueCapacity) {
+        // make room by dropping one abandoned job
+        const auto abandoned = std::find_if(m_queue.rbegin(), m_queue.rend(), [](const auto &job) {
+            return job->waiters == 0;
+        });
+        if (abandoned == m_queue.rend()) {
+            return false;
+        }
+        m_jobs.erase((*abandoned)->key);
+        m_queue.erase(std::next(abandoned).base());
+        ++m_cancelled;
+    }
+
+    const auto job = std::make_shared<Job>();
+    job->key = connection.key;
+    job->waiters = 1;
+    m_jobs.emplace(job->key, job);
+    m_queue.push_back(job);
+    m_queueCondition.notify_one();
+    return true;
+}
+
+void TileServer::detach(Connection &connection)
+{
+    const auto range = m_waiting.equal_range(connection.key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == connection.fd) {
+            m_waiting.erase(it);
+            break;
+        }
+    }
+
+    std::lock_guard lock(m_mutex);
+    const auto it = m_jobs.find(connection.key);
+    if (it == m_jobs.end() || it->second->waiters == 0) {
+        return;
+    }
+    const auto job = it->second;
+    if (--job->waiters == 0) {
+        job->cancelled = true;
+        if (!job->running) {
+            // deprioritise: live requests queued after it go first
+            m_queue.erase(std::find(m_queue.begin(), m_queue.end(), job));
+            m_queue.push_back(job);
+        }
+    }
+}
+
+void TileServer::respond(Connection &connection,
+                         const std::string &status,
+                         const std::string &contentType,
+                         const std::string &body)
+{
+    std::ostringstream stream;
+    stream << "HTTP/1.1 " << status << "\r\n"
+           << "Content-Type: " << contentType << "\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Access-Control-Allow-Origin: *\r\n";
+    if (status.starts_with("503")) {
+        stream << "Retry-After: 1\r\n";
+    } else if (connection.tileRequest) {
+        stream << "Cache-Control: public, max-age=86400\r\n";
+    }
+    stream << "Connection: close\r\n\r\n";
+    connection.out = stream.str() + body;
+    connection.written = 0;
+    connection.state = ConnectionState::Writing;
+    writeResponse(connection);
+}
+
+void TileServer::writeResponse(Connection &connection)
+{
+    while (connection.written < connection.out.size()) {
+        const auto size = ::send(connection.fd,
+                                 connection.out.data() + connection.written,
+                                 connection.out.size() - connection.written,
+                                 MSG_NOSIGNAL);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else if (size <= 0) {
+            break;
+        }
+        connection.written += size;
+    }
+    if (connection.tileRequest && connection.written == connection.out.size()) {
+        recordLatency(Clock::now() - connection.begin);
+    }
+    closeConnection(connection.fd);
+}
+
+void TileServer::dropIdleConnections()
+{
+    const auto now = Clock::now();
+    std::vector<int> idle;
+    for (const auto &[fd, connection] : m_connections) {
+        if (connection.state == ConnectionState::Reading
+            && now - connection.lastActivity > readTimeout) {
+            idle.push_back(fd);
+        }
+    }
+    for (const int fd : idle) {
+        closeConnection(fd);
+    }
+}
+
+void TileServer::closeConnection(int fd)
+{
+    ::close(fd);
+    m_connections.erase(fd);
+}
+
+void TileServer::dispatchCompletions()
+{
+    std::vector<Completion> completions;
+    {
+        std::lock_guard lock(m_mutex);
+        completions.swap(m_completions);
+    }
+
+    for (const auto &completion : completions) {
+        const auto range = m_waiting.equal_range(completion.key);
+        std::vector<int> fds;
+        for (auto it = range.first; it != range.second; ++it) {
+            fds.push_back(it->second);
+        }
+        m_waiting.erase(range.first, range.second);
+
+        for (const int fd : fds) {
+            const auto it = m_connections.find(fd);
+            if (it == m_connections.end()) {
+                continue;
+            }
+            if (completion.png) {
+                respond(it->second, "200 OK", "image/png", *completion.png);
+            } else {
+                respond(it->second, "500 Internal Server Error", "text/plain", "");
+            }
+        }
+    }
+}
+
+void TileServer::recordLatency(Clock::duration latency)
+{
+    const auto ms = std::chrono::duration<double, std::milli>(latency).count();
+    std::lock_guard lock(m_statsMutex);
+    if (m_latencies.size() < latencyWindow) {
+        m_latencies.push_back(ms);
+    } else {
+        m_latencies[m_latencyCursor] = ms;
+        m_latencyCursor = (m_latencyCursor + 1) % latencyWindow;
+    }
+}
+
+std::string TileServer::statsJson() const
+{
+    std::vector<double> latencies;
+    {
+        std::lock_guard lock(m_statsMutex);
+        latencies = m_latencies;
+    }
+    std::size_t queued;
+    {
+        std::lock_guard lock(m_mutex);
+        queued = m_queue.size();
+    }
+
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3) << "{\"requests\": " << m_requests
+           << ", \"memory_hits\": " << m_memoryHits << ", \"disk_hits\": " << m_diskHits
+           << ", \"rendered\": " << m_rendered << ", \"coalesced\": " << m_coalesced
+           << ", \"cancelled\": " << m_cancelled << ", \"rejected\": " << m_rejected
+           << ", \"queued\": " << queued << ", \"p50_ms\": " << percentile(latencies, 0.5)
+           << ", \"p99_ms\": " << percentile(latencies, 0.99) << "}";
+    return stream.str();
+}
+
+void TileServer::printStats() const
+{
+    std::cout << "Tile stats: " << statsJson() << std::endl;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <e172/graphics/color.h>
+#include <e172/math/math.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The TileServer class serves slippy-map tiles (`GET /{z}/{x}/{y}.png`) on localhost.
+ * Tile z/x/y covers 1/2^z of the [-2, 2] x [-2, 2] plane shown by FractalView at zoom 0.5.
+ * Requests for the same tile share one render job, abandoned jobs are cancelled, rendered
+ * tiles are kept in an in-memory LRU and in a disk cache. `GET /stats` reports latencies.
+ */
+class TileServer
+{
+public:
+    struct Settings
+    {
+        std::uint16_t port = 8080;
+        std::size_t workerCount = 0;
+        std::size_t queueCapacity = 256;
+        std::size_t memoryCacheCapacity = 4096;
+        std::size_t tileSize = 256;
+        std::string cacheDir = "./tile_cache";
+        std::string functionName;
+        std::size_t depthMultiplier = 32;
+        e172::Color colorMask = 0xffff0000;
+        e172::Color backgroundColor = 0xffffffff;
+    };
+
+    TileServer(const e172::ComplexFunction<double> &function, const Settings &settings);
+    TileServer(const TileServer &) = delete;
+    ~TileServer();
+
+    /**
+     * @brief exec - runs the event loop until SIGINT/SIGTERM
+     * @return process exit code
+     */
+    int exec();
+
+    std::string statsJson() const;
+
+private:
+    struct TileKey
+    {
+        std::uint32_t z;
+        std::uint64_t x;
+        std::uint64_t y;
+
+        auto operator<=>(const TileKey &) const = default;
+    };
+
+    struct Job
+    {
+        TileKey key;
+        std::size_t waiters = 0;
+        bool running = false;
+        std::atomic<bool> cancelled = false;
+    };
+
+    struct Completion
+    {
+        TileKey key;
+        std::shared_ptr<const std::string> png;
+    };
+
+    enum class ConnectionState { Reading, Waiting, Writing };
+
+    struct Connection
+    {
+        int fd;
+        ConnectionState state = ConnectionState::Reading;
+        std::string in;
+        std::string out;
+        std::size_t written = 0;
+        bool tileRequest = false;
+        TileKey key{};
+        std::chrono::steady_clock::time_point begin;
+        /// last time request bytes arrived
+        std::chrono::steady_clock::time_point lastActivity;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    void workerLoop();
+    /**
+     * @brief produceTile - reads tile from disk cache or renders it
+     * @param cancelled - set when rendering was cancelled (nullptr returned)
+     */
+    std::shared_ptr<const std::string> produceTile(Job &job, bool &cancelled);
+    bool renderTile(const Job &job, std::vector<e172::Color> &pixels) const;
+    std::string tilePath(const TileKey &key) const;
+
+    std::shared_ptr<const std::string> cacheLookup(const TileKey &key);
+    void cacheInsert(const TileKey &key, std::shared_ptr<const std::string> png);
+
+    void acceptConnections();
+    void readRequest(Connection &connection);
+    void handleRequest(Connection &connection, const std::string &target);
+    bool enqueue(Connection &connection);
+    void detach(Connection &connection);
+    void respond(Connection &connection,
+                 const std::string &status,
+                 const std::string &contentType,
+                 const std::string &body);
+    void writeResponse(Connection &connection);
+    /// closes connections stuck in Reading for longer than the read timeout
+    void dropIdleConnections();
+    void closeConnection(int fd);
+    void dispatchCompletions();
+
+    void recordLatency(Clock::duration latency);
+    void printStats() const;
+
+private:
+    e172::ComplexFunction<double> m_function;
+    Settings m_settings;
+    std::string m_cacheRoot;
+
+    int m_listenFd = -1;
+    int m_wakePipe[2] = {-1, -1};
+    std::map<int, Connection> m_connections;
+    std::multimap<TileKey, int> m_waiting;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueCondition;
+    std::deque<std::shared_ptr<Job>> m_queue;
+    std::map<TileKey, std::shared_ptr<Job>> m_jobs;
+    std::vector<Completion> m_completions;
+    bool m_stopping = false;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_cacheMutex;
+    std::list<std::pair<TileKey, std::shared_ptr<const std::string>>> m_cacheOrder;
+    std::map<TileKey, decltype(m_cacheOrder)::iterator> m_cache;
+
+    mutable std::mutex m_statsMutex;
+    std::vector<double> m_latencies;
+    std::size_t m_latencyCursor = 0;
+    std::atomic<std::size_t> m_requests = 0;
+    std::atomic<std::size_t> m_memoryHits = 0;
+    std::atomic<std::size_t> m_diskHits = 0;
+    std::atomic<std::size_t> m_rendered = 0;
+    std::atomic<std::size_t> m_coalesced = 0;
+    std::atomic<std::size_t> m_cancelled = 0;
+    std::atomic<std::size_t> m_rejected = 0;
+};
@@ -0,0 +1,208 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event
+{
+    const char *name;
+    std::int64_t arg;
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+constexpr std::size_t chunkSize = 4096;
+
+/**
+ * @brief The Chunk struct - written by its owner thread only. count is published with release
+ * after an event is written, so the exporter can read the first count events at any time
+ */
+struct Chunk
+{
+    Event events[chunkSize];
+    std::atomic<std::size_t> count = 0;
+    std::atomic<Chunk *> next = nullptr;
+};
+
+struct ThreadBuffer
+{
+    std::size_t id;
+    /// guarded by Registry::mutex
+    std::string name;
+    Chunk *first = new Chunk;
+    Chunk *current = first;
+    std::size_t recorded = 0;
+    std::atomic<std::size_t> dropped = 0;
+};
+
+/**
+ * @brief The Registry struct - list of thread buffers. Never destroyed: worker threads (TBB pool)
+ * may still record during static destruction
+ */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<ThreadBuffer *> buffers;
+    /// buffers of exited threads. Their events are kept and a new thread appends after them
+    /// under the same tid, so short lived threads reuse a few buffers instead of leaking one each
+    std::vector<ThreadBuffer *> released;
+};
+
+Registry &registry()
+{
+    static auto *registry = new Registry;
+    return *registry;
+}
+
+/**
+ * @brief The BufferOwner struct - releases buffer of a thread when the thread exits
+ */
+struct BufferOwner
+{
+    ThreadBuffer *buffer = nullptr;
+
+    ~BufferOwner()
+    {
+        if (buffer) {
+            auto &r = registry();
+            std::lock_guard lock(r.mutex);
+            r.released.push_back(buffer);
+        }
+    }
+};
+
+ThreadBuffer &threadBuffer()
+{
+    thread_local BufferOwner owner;
+    if (!owner.buffer) {
+        auto &r = registry();
+        std::lock_guard lock(r.mutex);
+        if (!r.released.empty()) {
+            owner.buffer = r.released.back();
+            r.released.pop_back();
+            // the new thread is unnamed until it calls setThreadName
+            owner.buffer->name.clear();
+        } else {
+            owner.buffer = new ThreadBuffer;
+            owner.buffer->id = r.buffers.size() + 1;
+            r.buffers.push_back(owner.buffer);
+        }
+    }
+    return *owner.buffer;
+}
+
+} // namespace
+
+void Tracer::start()
+{
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(const std::string &name)
+{
+    auto &buffer = threadBuffer();
+    std::lock_guard lock(registry().mutex);
+    buffer.name = name;
+}
+
+void Tracer::record(const char *name,
+                    std::int64_t arg,
+                    std::uint64_t beginNs,
+                    std::uint64_t endNs)
+{
+    auto &buffer = threadBuffer();
+    if (buffer.recorded >= maxEventsPerThread) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto *chunk = buffer.current;
+    auto count = chunk->count.load(std::memory_order_relaxed);
+    if (count == chunkSize) {
+        auto *next = new Chunk;
+        chunk->next.store(next, std::memory_order_release);
+        buffer.current = chunk = next;
+        count = 0;
+    }
+    chunk->events[count] = Event{.name = name, .arg = arg, .begin = beginNs, .end = endNs};
+    chunk->count.store(count + 1, std::memory_order_release);
+    ++buffer.recorded;
+}
+
+std::uint64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+bool Tracer::write(const std::string &path)
+{
+    auto &r = registry();
+    std::lock_guard lock(r.mutex);
+
+    std::uint64_t origin = std::numeric_limits<std::uint64_t>::max();
+    for (const auto *buffer : r.buffers) {
+        for (const auto *chunk = buffer->first; chunk;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            const auto count = chunk->count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < count; ++i) {
+                origin = std::min(origin, chunk->events[i].begin);
+            }
+        }
+    }
+
+    std::ofstream stream(path);
+    stream << std::fixed << std::setprecision(3)
+           << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *separator = "\n";
+    std::size_t dropped = 0;
+    for (const auto *buffer : r.buffers) {
+        const auto name = buffer->name.empty() ? "thread " + std::to_string(buffer->id)
+                                               : buffer->name;
+        stream << separator << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": "
+               << buffer->id << ", \"args\": {\"name\": \"" << name << "\"}}";
+        separator = ",\n";
+        for (const auto *chunk = buffer->first; chunk;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            const auto count = chunk->count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < count; ++i) {
+                const auto &event = chunk->events[i];
+                stream << separator << "{\"ph\": \"X\", \"name\": \"" << event.name
+                       << "\", \"pid\": 1, \"tid\": " << buffer->id
+                       << ", \"ts\": " << double(event.begin - origin) / 1000
+                       << ", \"dur\": " << double(event.end - event.begin) / 1000;
+                if (event.arg >= 0) {
+                    stream << ", \"args\": {\"index\": " << event.arg << "}";
+                }
+                stream << "}";
+            }
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    stream << "\n], \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+    return bool(stream);
+}
+
+TraceSession::TraceSession(const std::string &path)
+    : m_path(path)
+{
+    if (!m_path.empty()) {
+        Tracer::start();
+        Tracer::setThreadName("main");
+    }
+}
+
+TraceSession::~TraceSession()
+{
+    if (!m_path.empty()) {
+        Tracer::write(m_path);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief The Tracer class records begin and end of tasks (rows, tiles, passes, color mapping,
+ * blit and encode stages) on every thread and exports them as Chrome trace JSON (viewable in
+ * Perfetto or chrome://tracing).
+ * Every thread appends to its own buffer of fixed size chunks, so recording takes no locks.
+ * Buffers of exited threads are handed to new threads, which keep recording under the same tid.
+ * When tracing is disabled a scope costs one relaxed atomic load
+ */
+class Tracer
+{
+public:
+    /// events kept per tid, later events are dropped (and counted)
+    static constexpr std::size_t maxEventsPerThread = std::size_t(1) << 20;
+
+    static void start();
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief setThreadName - name of calling thread in the exported trace
+     */
+    static void setThreadName(const std::string &name);
+
+    /**
+     * @brief record - appends complete event of calling thread
+     * @param name - must outlive the tracer (string literal)
+     */
+    static void record(const char *name,
+                       std::int64_t arg,
+                       std::uint64_t beginNs,
+                       std::uint64_t endNs);
+
+    /**
+     * @brief write - exports events recorded so far. Threads may keep recording meanwhile
+     */
+    static bool write(const std::string &path);
+
+    static std::uint64_t now();
+
+private:
+    static inline std::atomic<bool> s_enabled = false;
+};
+
+/**
+ * @brief The TraceScope class records its lifetime as one event
+ */
+class TraceScope
+{
+public:
+    /**
+     * @param name - must outlive the tracer (string literal)
+     * @param arg - task index (row, tile, deterioration), -1 if none
+     */
+    TraceScope(const char *name, std::int64_t arg = -1)
+        : m_name(Tracer::enabled() ? name : nullptr)
+        , m_arg(arg)
+        , m_begin(m_name ? Tracer::now() : 0)
+    {}
+
+    TraceScope(const TraceScope &) = delete;
+
+    ~TraceScope()
+    {
+        if (m_name) {
+            Tracer::record(m_name, m_arg, m_begin, Tracer::now());
+        }
+    }
+
+private:
+    const char *m_name;
+    std::int64_t m_arg;
+    std::uint64_t m_begin;
+};
+
+/**
+ * @brief The TraceSession class enables tracing for its lifetime and writes the trace to path
+ * when destroyed. Does nothing if path is empty
+ */
+class TraceSession
+{
+public:
+    TraceSession(const std::string &path);
+    TraceSession(const TraceSession &) = delete;
+    ~TraceSession();
+
+private:
+    std::string m_path;
+};